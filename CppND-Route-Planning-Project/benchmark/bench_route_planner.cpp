@@ -0,0 +1,177 @@
+#include "benchmark/benchmark.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../src/model.h"
+#include "../src/osm_generator.h"
+#include "../src/route_model.h"
+#include "../src/route_planner.h"
+
+
+//--------------------------------//
+//   Benchmark maps.
+//--------------------------------//
+
+// Map argument of every benchmark: the sample map the tests use, then a synthetic grid and
+// a synthetic city of increasing size.
+enum MapSize { Small, Medium, Large };
+
+// OSM XML of a benchmark map. The sample map is read from ../map.osm, like the tests do,
+// and is empty if that file is missing; the synthetic maps are generated once and kept for
+// the whole run.
+static const std::vector<std::byte> &MapData(int size) {
+    static std::map<int, std::vector<std::byte>> maps;
+    auto &data = maps[size];
+    if (data.empty()) {
+        std::string xml;
+        if (size == Small) {
+            std::ifstream is{"../map.osm", std::ios::binary};
+            xml.assign(std::istreambuf_iterator<char>{is}, {});
+        }
+        else {
+            OsmGenerator::Options options;
+            options.layout = size == Medium ? OsmGenerator::Layout::Grid : OsmGenerator::Layout::City;
+            options.nodes = size == Medium ? 75000 : 700000;
+            std::ostringstream osm;
+            OsmGenerator{options}.Write(osm);
+            xml = osm.str();
+        }
+        auto bytes = reinterpret_cast<const std::byte *>(xml.data());
+        data.assign(bytes, bytes + xml.size());
+    }
+    return data;
+}
+
+static const RouteModel &MapModel(int size) {
+    static std::map<int, std::unique_ptr<RouteModel>> models;
+    auto &model = models[size];
+    if (!model)
+        model = std::make_unique<RouteModel>(MapData(size));
+    return *model;
+}
+
+// Skips the benchmark when its map is unavailable, as the sample map is in a fresh checkout.
+static bool SkipIfMissing(benchmark::State &state) {
+    if (!MapData(state.range(0)).empty())
+        return false;
+    state.SkipWithError("../map.osm not found; run the benchmarks from within build");
+    return true;
+}
+
+static const char *MapName(int size) {
+    return size == Small ? "map.osm" : size == Medium ? "grid-75k" : "city-700k";
+}
+
+// Fixed sequence of query points in percent of the map, as RoutePlanner takes them.
+static std::vector<std::pair<float, float>> QueryPoints(std::size_t count) {
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> percent(0.f, 100.f);
+    std::vector<std::pair<float, float>> points(count);
+    for (auto &point : points)
+        point = {percent(random), percent(random)};
+    return points;
+}
+
+
+//--------------------------------//
+//   Benchmarks.
+//--------------------------------//
+
+static void BM_ModelLoad(benchmark::State &state) {
+    if (SkipIfMissing(state))
+        return;
+    const auto &data = MapData(state.range(0));
+    for (auto _ : state) {
+        Model model{data};
+        benchmark::DoNotOptimize(model.Nodes().data());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(MapName(state.range(0)));
+}
+
+
+static void BM_RouteModelConstruction(benchmark::State &state) {
+    if (SkipIfMissing(state))
+        return;
+    const auto &data = MapData(state.range(0));
+    for (auto _ : state) {
+        RouteModel model{data};
+        benchmark::DoNotOptimize(model.SNodes().data());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(MapName(state.range(0)));
+}
+
+
+static void BM_FindClosestNode(benchmark::State &state) {
+    if (SkipIfMissing(state))
+        return;
+    const auto &model = MapModel(state.range(0));
+    const auto points = QueryPoints(1024);
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const auto &point = points[i++ % points.size()];
+        benchmark::DoNotOptimize(&model.FindClosestNode(point.first * 0.01f, point.second * 0.01f));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(MapName(state.range(0)));
+}
+
+
+// The A* inner loop: the first 1000 expansions of a query across the map.
+static void BM_AddNeighborsNextNode(benchmark::State &state) {
+    if (SkipIfMissing(state))
+        return;
+    const auto &model = MapModel(state.range(0));
+    RoutePlanner planner{model, 10, 10, 90, 90};
+    auto &workspace = planner.Workspace();
+    const auto &start = model.FindClosestNode(0.1f, 0.1f);
+    std::int64_t expanded = 0;
+    for (auto _ : state) {
+        workspace.Reset();
+        workspace.Visit(start.Index(), -1, 0.f, planner.CalculateHValue(&start));
+        workspace.OpenList().Push(start.Index(), 0.f);
+        const RouteModel::Node *current = nullptr;
+        for (int i = 0; i < 1000 && (current = planner.NextNode()) != nullptr; i++, expanded++)
+            planner.AddNeighbors(current);
+        benchmark::DoNotOptimize(current);
+    }
+    state.SetItemsProcessed(expanded);
+    state.SetLabel(MapName(state.range(0)));
+}
+
+
+static void BM_AStarSearch(benchmark::State &state) {
+    if (SkipIfMissing(state))
+        return;
+    const auto &model = MapModel(state.range(0));
+    const auto points = QueryPoints(256);
+    SearchWorkspace workspace(model.SNodes().size());
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const auto &start = points[i++ % points.size()];
+        const auto &end = points[i++ % points.size()];
+        RoutePlanner planner{model, workspace, start.first, start.second, end.first, end.second};
+        planner.AStarSearch();
+        benchmark::DoNotOptimize(planner.GetDistance());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(MapName(state.range(0)));
+}
+
+
+BENCHMARK(BM_ModelLoad)->DenseRange(Small, Large)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RouteModelConstruction)->DenseRange(Small, Large)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FindClosestNode)->DenseRange(Small, Large);
+BENCHMARK(BM_AddNeighborsNextNode)->DenseRange(Small, Large)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_AStarSearch)->DenseRange(Small, Large)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,324 @@
+#include "contraction_hierarchy.h"
+#include "map_cache.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+static constexpr float infinity = std::numeric_limits<float>::max();
+
+// Mutable graph the hierarchy is built on: the road graph minus the contracted nodes,
+// plus the shortcuts added so far.
+class Contraction {
+  public:
+    struct Edge {
+        int target;
+        float length;
+        int middle;
+    };
+
+    explicit Contraction(const RouteModel::Graph &graph)
+        : m_Edges(graph.offsets.size() - 1),
+          m_ContractedNeighbors(m_Edges.size(), 0),
+          m_WitnessTarget(m_Edges.size(), false),
+          m_WitnessLength(m_Edges.size(), infinity),
+          m_WitnessGeneration(m_Edges.size(), 0),
+          m_WitnessHeap(m_Edges.size()) {
+        for (int node = 0; node < (int)m_Edges.size(); ++node)
+            for (int edge = graph.offsets[node]; edge < graph.offsets[node + 1]; ++edge)
+                AddEdge(node, graph.targets[edge], graph.weights[edge], -1);
+    }
+
+    std::size_t Size() const noexcept { return m_Edges.size(); }
+
+    // Edge difference plus the number of already contracted neighbors, which spreads
+    // contractions evenly over the map. Lower is contracted first.
+    float Priority(int node) {
+        const int shortcuts = AddShortcuts(node, true);
+        const int degree = (int)m_Edges[node].size();
+        return (float)(shortcuts - degree + m_ContractedNeighbors[node]);
+    }
+
+    // Contracts node, returning its remaining edges, which become its upward edges.
+    std::vector<Edge> Contract(int node) {
+        AddShortcuts(node, false);
+        auto upward = m_Edges[node];
+        for (const auto &edge : upward) {
+            auto &edges = m_Edges[edge.target];
+            edges.erase(std::remove_if(edges.begin(), edges.end(), [node](const Edge &e) { return e.target == node; }), edges.end());
+            m_ContractedNeighbors[edge.target]++;
+        }
+        m_Edges[node] = {};
+        return upward;
+    }
+
+  private:
+    static constexpr int witness_settle_limit = 500;
+
+    void AddEdge(int from, int to, float length, int middle) {
+        for (auto &edge : m_Edges[from]) {
+            if (edge.target == to) {
+                if (length < edge.length)
+                    edge = {to, length, middle};
+                return;
+            }
+        }
+        m_Edges[from].push_back({to, length, middle});
+    }
+
+    // Adds (or, when simulating, only counts) the shortcuts needed to contract node.
+    // Each pair of neighbors u, w gets a shortcut unless a witness search from u that
+    // avoids node finds a path to w no longer than the one through node.
+    int AddShortcuts(int node, bool simulate) {
+        const auto neighbors = m_Edges[node];
+        int shortcuts = 0;
+        for (std::size_t i = 0; i + 1 < neighbors.size(); ++i) {
+            float max_length = 0.0f;
+            for (std::size_t j = i + 1; j < neighbors.size(); ++j) {
+                max_length = std::max(max_length, neighbors[i].length + neighbors[j].length);
+                m_WitnessTarget[neighbors[j].target] = true;
+            }
+            WitnessSearch(neighbors[i].target, node, max_length, (int)(neighbors.size() - i - 1));
+            for (std::size_t j = i + 1; j < neighbors.size(); ++j)
+                m_WitnessTarget[neighbors[j].target] = false;
+            for (std::size_t j = i + 1; j < neighbors.size(); ++j) {
+                const float length = neighbors[i].length + neighbors[j].length;
+                if (WitnessLength(neighbors[j].target) <= length)
+                    continue;
+                shortcuts++;
+                if (!simulate) {
+                    AddEdge(neighbors[i].target, neighbors[j].target, length, node);
+                    AddEdge(neighbors[j].target, neighbors[i].target, length, node);
+                }
+            }
+        }
+        return shortcuts;
+    }
+
+    float WitnessLength(int node) const {
+        return m_WitnessGeneration[node] == m_CurrentGeneration ? m_WitnessLength[node] : infinity;
+    }
+
+    // Bounded Dijkstra from source over uncontracted nodes other than avoid. Stops once
+    // all targets are settled, at max_length or after a fixed number of settled nodes;
+    // a missed witness only costs an unnecessary shortcut.
+    void WitnessSearch(int source, int avoid, float max_length, int targets) {
+        ++m_CurrentGeneration;
+        m_WitnessHeap.Clear();
+        m_WitnessGeneration[source] = m_CurrentGeneration;
+        m_WitnessLength[source] = 0.0f;
+        m_WitnessHeap.Push(source, 0.0f);
+        for (int settled = 0; !m_WitnessHeap.Empty() && settled < witness_settle_limit; ++settled) {
+            if (m_WitnessHeap.TopKey() > max_length)
+                break;
+            const float length = m_WitnessHeap.TopKey();
+            const int current = m_WitnessHeap.Pop();
+            if (m_WitnessTarget[current] && --targets == 0)
+                break;
+            for (const auto &edge : m_Edges[current]) {
+                if (edge.target == avoid)
+                    continue;
+                if (length + edge.length < WitnessLength(edge.target)) {
+                    m_WitnessGeneration[edge.target] = m_CurrentGeneration;
+                    m_WitnessLength[edge.target] = length + edge.length;
+                    m_WitnessHeap.Push(edge.target, length + edge.length);
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<Edge>> m_Edges;
+    std::vector<int> m_ContractedNeighbors;
+
+    std::vector<bool> m_WitnessTarget;
+    std::vector<float> m_WitnessLength;
+    std::vector<std::uint32_t> m_WitnessGeneration;
+    std::uint32_t m_CurrentGeneration = 0;
+    IndexedHeap m_WitnessHeap;
+};
+
+
+// Contracts nodes by lowest priority first. Priorities are updated lazily: a node taken
+// from the queue is re-evaluated and put back if it is no longer the least important.
+ContractionHierarchy::ContractionHierarchy(const RouteModel::Graph &graph) {
+    Contraction contraction(graph);
+    const int node_count = (int)contraction.Size();
+
+    IndexedHeap queue(node_count);
+    for (int node = 0; node < node_count; ++node)
+        queue.Push(node, contraction.Priority(node));
+
+    std::vector<std::vector<Contraction::Edge>> upward(node_count);
+    m_Rank.assign(node_count, -1);
+    int rank = 0;
+    while (!queue.Empty()) {
+        const int node = queue.Pop();
+        const float priority = contraction.Priority(node);
+        if (!queue.Empty() && priority > queue.TopKey()) {
+            queue.Push(node, priority);
+            continue;
+        }
+        upward[node] = contraction.Contract(node);
+        m_Rank[node] = rank++;
+    }
+
+    m_Offsets.assign(node_count + 1, 0);
+    for (int node = 0; node < node_count; ++node) {
+        m_Offsets[node + 1] = m_Offsets[node] + (int)upward[node].size();
+        for (const auto &edge : upward[node]) {
+            m_Targets.push_back(edge.target);
+            m_Lengths.push_back(edge.length);
+            m_Middle.push_back(edge.middle);
+        }
+    }
+}
+
+
+ContractionHierarchy::ContractionHierarchy(MapCacheReader &cache) {
+    m_Rank = cache.Array<int>();
+    m_Offsets = cache.Array<int>();
+    m_Targets = cache.Array<int>();
+    m_Lengths = cache.Array<float>();
+    m_Middle = cache.Array<int>();
+    if (m_Offsets.size() != m_Rank.size() + 1 || m_Targets.size() != m_Lengths.size() || m_Targets.size() != m_Middle.size())
+        throw std::logic_error("map cache is corrupted");
+    MapCacheReader::CheckOffsets(m_Offsets, m_Targets.size());
+    MapCacheReader::CheckIndices(m_Targets, m_Rank.size());
+    for (int middle : m_Middle)
+        if (middle != -1)
+            MapCacheReader::CheckIndex(middle, m_Rank.size());
+}
+
+
+void ContractionHierarchy::Save(MapCacheWriter &cache) const {
+    cache.Array(m_Rank);
+    cache.Array(m_Offsets);
+    cache.Array(m_Targets);
+    cache.Array(m_Lengths);
+    cache.Array(m_Middle);
+}
+
+
+// Both searches only relax upward edges; since road graph edges are symmetric, the backward
+// search uses the same upward graph. A direction stops once its lowest key cannot improve
+// on the best meeting point, the highest ranked node of the shortest path.
+float ContractionHierarchy::Query(SearchWorkspace &workspace, int source, int target, std::vector<int> &path) const {
+    auto &backward = workspace.Reverse();
+    workspace.Reset();
+    backward.Reset();
+    path.clear();
+    workspace.Visit(source, -1, 0.0f, 0.0f);
+    workspace.OpenList().Push(source, 0.0f);
+    backward.Visit(target, -1, 0.0f, 0.0f);
+    backward.OpenList().Push(target, 0.0f);
+
+    float best_length = infinity;
+    int meeting_node = -1;
+    auto done = [&](const SearchWorkspace &search) {
+        return search.OpenList().Empty() || search.OpenList().TopKey() >= best_length;
+    };
+    while (!done(workspace) || !done(backward)) {
+        const bool forward_turn = !done(workspace) &&
+            (done(backward) || workspace.OpenList().TopKey() <= backward.OpenList().TopKey());
+        auto &search = forward_turn ? workspace : backward;
+        const auto &opposite = forward_turn ? backward : workspace;
+        auto &open_list = search.OpenList();
+
+        const int current = open_list.Pop();
+        const float current_length = search.GValue(current);
+        if (opposite.Visited(current) && current_length + opposite.GValue(current) < best_length) {
+            best_length = current_length + opposite.GValue(current);
+            meeting_node = current;
+        }
+        if (Stalled(search, current))
+            continue;
+        for (int edge = m_Offsets[current]; edge < m_Offsets[current + 1]; ++edge) {
+            const int neighbor = m_Targets[edge];
+            const float length = current_length + m_Lengths[edge];
+            if (!search.Visited(neighbor)) {
+                search.Visit(neighbor, current, length, 0.0f);
+                open_list.Push(neighbor, length);
+            }
+            else if (length < search.GValue(neighbor) && open_list.Contains(neighbor)) {
+                search.Relax(neighbor, current, length);
+                open_list.DecreaseKey(neighbor, length);
+            }
+        }
+    }
+    if (meeting_node < 0)
+        return infinity;
+
+    // Hierarchy path: the forward parent chain reversed, then the backward parent chain.
+    std::vector<int> hierarchy_path;
+    for (int node = meeting_node; node >= 0; node = workspace.Parent(node))
+        hierarchy_path.push_back(node);
+    std::reverse(hierarchy_path.begin(), hierarchy_path.end());
+    for (int node = backward.Parent(meeting_node); node >= 0; node = backward.Parent(node))
+        hierarchy_path.push_back(node);
+
+    path.push_back(source);
+    for (std::size_t i = 1; i < hierarchy_path.size(); ++i)
+        Unpack(hierarchy_path[i - 1], hierarchy_path[i], path);
+    return best_length;
+}
+
+
+void ContractionHierarchy::UpwardSearch(SearchWorkspace &workspace, int source,
+                                        std::vector<std::pair<int, float>> &settled) const {
+    auto &open_list = workspace.OpenList();
+    workspace.Reset();
+    settled.clear();
+    workspace.Visit(source, -1, 0.0f, 0.0f);
+    open_list.Push(source, 0.0f);
+    while (!open_list.Empty()) {
+        const int current = open_list.Pop();
+        const float current_length = workspace.GValue(current);
+        if (Stalled(workspace, current))
+            continue;
+        settled.emplace_back(current, current_length);
+        for (int edge = m_Offsets[current]; edge < m_Offsets[current + 1]; ++edge) {
+            const int neighbor = m_Targets[edge];
+            const float length = current_length + m_Lengths[edge];
+            if (!workspace.Visited(neighbor)) {
+                workspace.Visit(neighbor, current, length, 0.0f);
+                open_list.Push(neighbor, length);
+            }
+            else if (length < workspace.GValue(neighbor) && open_list.Contains(neighbor)) {
+                workspace.Relax(neighbor, current, length);
+                open_list.DecreaseKey(neighbor, length);
+            }
+        }
+    }
+}
+
+
+// Stall-on-demand: a node reached more cheaply through a higher ranked neighbor than by
+// its tentative distance is not on a shortest up-path, so expanding it can be skipped.
+bool ContractionHierarchy::Stalled(const SearchWorkspace &search, int node) const {
+    const float length = search.GValue(node);
+    for (int edge = m_Offsets[node]; edge < m_Offsets[node + 1]; ++edge)
+        if (search.Visited(m_Targets[edge]) && search.GValue(m_Targets[edge]) + m_Lengths[edge] < length)
+            return true;
+    return false;
+}
+
+
+int ContractionHierarchy::FindEdge(int from, int to) const {
+    const int lower = m_Rank[from] < m_Rank[to] ? from : to;
+    const int higher = lower == from ? to : from;
+    for (int edge = m_Offsets[lower]; edge < m_Offsets[lower + 1]; ++edge)
+        if (m_Targets[edge] == higher)
+            return edge;
+    throw std::logic_error("contraction hierarchy has no edge between adjacent path nodes");
+}
+
+
+void ContractionHierarchy::Unpack(int from, int to, std::vector<int> &path) const {
+    const int middle = m_Middle[FindEdge(from, to)];
+    if (middle < 0) {
+        path.push_back(to);
+        return;
+    }
+    Unpack(from, middle, path);
+    Unpack(middle, to, path);
+}
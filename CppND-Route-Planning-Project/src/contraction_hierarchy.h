@@ -0,0 +1,57 @@
+#ifndef CONTRACTION_HIERARCHY_H
+#define CONTRACTION_HIERARCHY_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "route_model.h"
+#include "search_workspace.h"
+
+class MapCacheReader;
+class MapCacheWriter;
+
+// Contraction hierarchy over a RouteModel's road graph. Preprocessing contracts the nodes
+// one by one in order of importance, adding a shortcut edge between two neighbors whenever
+// the path through the contracted node is the only shortest one. A query then runs two
+// Dijkstra searches, from the source and the target, that only follow edges to higher
+// ranked nodes, so each settles a small fraction of the graph. Shortcuts remember the node
+// they bypass and are unpacked recursively into road graph nodes.
+class ContractionHierarchy {
+  public:
+    explicit ContractionHierarchy(const RouteModel::Graph &graph);
+    explicit ContractionHierarchy(MapCacheReader &cache);
+    void Save(MapCacheWriter &cache) const;
+
+    std::size_t Size() const noexcept { return m_Rank.size(); }
+    // Number of upward edges, shortcuts included.
+    std::size_t EdgeCount() const noexcept { return m_Targets.size(); }
+    int Rank(int node) const { return m_Rank[node]; }
+
+    // Shortest path length from source to target in road graph units, or infinity if the
+    // target is unreachable. path receives the road graph nodes from source to target.
+    // The forward search uses workspace and the backward search workspace.Reverse().
+    float Query(SearchWorkspace &workspace, int source, int target, std::vector<int> &path) const;
+
+    // Complete upward search from source, the half of a query that only depends on one
+    // endpoint. settled receives every settled, non-stalled node with its distance.
+    void UpwardSearch(SearchWorkspace &workspace, int source, std::vector<std::pair<int, float>> &settled) const;
+
+  private:
+    bool Stalled(const SearchWorkspace &search, int node) const;
+    // Upward edge between two adjacent nodes; it is stored at the lower ranked one.
+    int FindEdge(int from, int to) const;
+    // Appends the road graph nodes after from up to and including to.
+    void Unpack(int from, int to, std::vector<int> &path) const;
+
+    std::vector<int> m_Rank;
+
+    // Upward graph in compressed sparse row form: the edges of node i to higher ranked
+    // nodes are [m_Offsets[i], m_Offsets[i + 1]). m_Middle holds the node bypassed by a
+    // shortcut, or -1 for an edge of the road graph.
+    std::vector<int> m_Offsets;
+    std::vector<int> m_Targets;
+    std::vector<float> m_Lengths;
+    std::vector<int> m_Middle;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "distance_kernels.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DISTANCE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+void SquaredDistancesScalar(const float *xs, const float *ys, std::size_t count, float x, float y, float *out) {
+    for (std::size_t i = 0; i < count; ++i) {
+        const float dx = xs[i] - x;
+        const float dy = ys[i] - y;
+        out[i] = dx * dx + dy * dy;
+    }
+}
+
+#ifdef DISTANCE_KERNELS_X86
+// Multiplies and adds are kept separate rather than fused, so that every kernel rounds
+// exactly like the scalar one and the nearest point does not depend on the CPU.
+__attribute__((target("avx2")))
+static void SquaredDistancesAVX2(const float *xs, const float *ys, std::size_t count, float x, float y, float *out) {
+    const __m256 qx = _mm256_set1_ps(x);
+    const __m256 qy = _mm256_set1_ps(y);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), qx);
+        const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), qy);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+    }
+    SquaredDistancesScalar(xs + i, ys + i, count - i, x, y, out + i);
+}
+
+__attribute__((target("sse2")))
+static void SquaredDistancesSSE2(const float *xs, const float *ys, std::size_t count, float x, float y, float *out) {
+    const __m128 qx = _mm_set1_ps(x);
+    const __m128 qy = _mm_set1_ps(y);
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), qx);
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + i), qy);
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+    }
+    SquaredDistancesScalar(xs + i, ys + i, count - i, x, y, out + i);
+}
+#endif
+
+using Kernel = void (*)(const float *, const float *, std::size_t, float, float, float *);
+
+struct KernelChoice {
+    Kernel kernel;
+    const char *name;
+};
+
+static KernelChoice SelectKernel() {
+#ifdef DISTANCE_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {SquaredDistancesAVX2, "avx2"};
+    if (__builtin_cpu_supports("sse2"))
+        return {SquaredDistancesSSE2, "sse2"};
+#endif
+    return {SquaredDistancesScalar, "scalar"};
+}
+
+static const KernelChoice &SelectedKernel() {
+    static const KernelChoice choice = SelectKernel();
+    return choice;
+}
+
+void SquaredDistances(const float *xs, const float *ys, std::size_t count, float x, float y, float *out) {
+    SelectedKernel().kernel(xs, ys, count, x, y, out);
+}
+
+const char *SquaredDistancesKernel() {
+    return SelectedKernel().name;
+}
@@ -0,0 +1,18 @@
+#ifndef DISTANCE_KERNELS_H
+#define DISTANCE_KERNELS_H
+
+#include <cstddef>
+
+// Squared distances from (x, y) to count points stored as separate coordinate arrays:
+// out[i] = (xs[i] - x)^2 + (ys[i] - y)^2. On x86 the widest of the AVX2, SSE2 and scalar
+// kernels supported by the CPU is selected at runtime, so the binary itself needs no
+// special compiler flags.
+void SquaredDistances(const float *xs, const float *ys, std::size_t count, float x, float y, float *out);
+
+// The portable kernel, which the vectorized ones must match exactly.
+void SquaredDistancesScalar(const float *xs, const float *ys, std::size_t count, float x, float y, float *out);
+
+// Name of the kernel selected for this CPU: "avx2", "sse2" or "scalar".
+const char *SquaredDistancesKernel();
+
+#endif
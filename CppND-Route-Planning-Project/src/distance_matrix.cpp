@@ -0,0 +1,142 @@
+#include "distance_matrix.h"
+#include "contraction_hierarchy.h"
+#include "parallel_for.h"
+#include "search_workspace.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+static constexpr float infinity = std::numeric_limits<float>::infinity();
+
+DistanceMatrix::DistanceMatrix(const RouteModel &model, std::vector<int> sources, std::vector<int> targets,
+                               unsigned threads, bool with_paths, RouteModel::Profile profile)
+    : m_Sources(std::move(sources)),
+      m_Targets(std::move(targets)),
+      m_Distances(m_Sources.size() * m_Targets.size(), infinity) {
+    if (model.Hierarchy(profile) && !with_paths)
+        ComputeWithHierarchy(model, threads, profile);
+    else
+        ComputeWithDijkstra(model, threads, with_paths, profile);
+}
+
+
+const std::vector<int> &DistanceMatrix::Path(std::size_t row, std::size_t column) const {
+    static const std::vector<int> empty;
+    return m_Paths.empty() ? empty : m_Paths[row * Columns() + column];
+}
+
+
+// One Dijkstra search per source over the profile's road graph, stopped once every target is settled.
+void DistanceMatrix::ComputeWithDijkstra(const RouteModel &model, unsigned threads, bool with_paths,
+                                         RouteModel::Profile profile) {
+    const auto &graph = model.RoadGraph(profile);
+    const auto node_count = model.SNodes().size();
+    std::vector<bool> is_target(node_count, false);
+    int target_count = 0;
+    for (int target : m_Targets)
+        if (!is_target[target]) {
+            is_target[target] = true;
+            target_count++;
+        }
+    if (with_paths)
+        m_Paths.resize(m_Distances.size());
+
+    ParallelFor(Rows(), ChunkCount(Rows(), threads), [&](std::size_t begin, std::size_t end, unsigned) {
+        SearchWorkspace workspace(node_count);
+        auto &open_list = workspace.OpenList();
+        for (auto row = begin; row < end; ++row) {
+            workspace.Reset();
+            workspace.Visit(m_Sources[row], -1, 0.0f, 0.0f);
+            open_list.Push(m_Sources[row], 0.0f);
+            int remaining = target_count;
+            while (!open_list.Empty() && remaining > 0) {
+                const int current = open_list.Pop();
+                if (is_target[current])
+                    remaining--;
+                const float current_weight = workspace.GValue(current);
+                for (int edge = graph.offsets[current]; edge < graph.offsets[current + 1]; ++edge) {
+                    const int neighbor = graph.targets[edge];
+                    const float weight = current_weight + graph.weights[edge];
+                    if (!workspace.Visited(neighbor)) {
+                        workspace.Visit(neighbor, current, weight, 0.0f);
+                        open_list.Push(neighbor, weight);
+                    }
+                    else if (weight < workspace.GValue(neighbor) && open_list.Contains(neighbor)) {
+                        workspace.Relax(neighbor, current, weight);
+                        open_list.DecreaseKey(neighbor, weight);
+                    }
+                }
+            }
+
+            for (std::size_t column = 0; column < Columns(); ++column) {
+                const int target = m_Targets[column];
+                if (!workspace.Visited(target))
+                    continue;
+                m_Distances[row * Columns() + column] = workspace.GValue(target) * graph.cost_scale;
+                if (with_paths) {
+                    auto &path = m_Paths[row * Columns() + column];
+                    for (int node = target; node >= 0; node = workspace.Parent(node))
+                        path.push_back(node);
+                    std::reverse(path.begin(), path.end());
+                }
+            }
+        }
+    });
+}
+
+
+// Bucket-based many-to-many search. The upward search space of each target is stored in
+// buckets at the nodes it settles; a source's upward search then meets every target in the
+// buckets of the nodes it settles, and the shortest meeting gives the distance.
+void DistanceMatrix::ComputeWithHierarchy(const RouteModel &model, unsigned threads, RouteModel::Profile profile) {
+    struct BucketEntry {
+        int node;
+        int column;
+        float length;
+    };
+
+    const auto &hierarchy = *model.Hierarchy(profile);
+    const float cost_scale = model.RoadGraph(profile).cost_scale;
+    const auto node_count = model.SNodes().size();
+
+    const auto target_chunks = ChunkCount(Columns(), threads);
+    std::vector<std::vector<BucketEntry>> chunk_entries(target_chunks);
+    ParallelFor(Columns(), target_chunks, [&](std::size_t begin, std::size_t end, unsigned chunk) {
+        SearchWorkspace workspace(node_count);
+        std::vector<std::pair<int, float>> settled;
+        for (auto column = begin; column < end; ++column) {
+            hierarchy.UpwardSearch(workspace, m_Targets[column], settled);
+            for (const auto &[node, length] : settled)
+                chunk_entries[chunk].push_back({node, (int)column, length});
+        }
+    });
+
+    // Buckets in compressed sparse row form, indexed by node.
+    std::vector<int> bucket_offsets(node_count + 1, 0);
+    for (const auto &entries : chunk_entries)
+        for (const auto &entry : entries)
+            bucket_offsets[entry.node + 1]++;
+    for (std::size_t i = 1; i < bucket_offsets.size(); ++i)
+        bucket_offsets[i] += bucket_offsets[i - 1];
+    std::vector<std::pair<int, float>> buckets(bucket_offsets.back());
+    std::vector<int> fill(bucket_offsets.begin(), bucket_offsets.end() - 1);
+    for (const auto &entries : chunk_entries)
+        for (const auto &entry : entries)
+            buckets[fill[entry.node]++] = {entry.column, entry.length};
+    chunk_entries.clear();
+
+    ParallelFor(Rows(), ChunkCount(Rows(), threads), [&](std::size_t begin, std::size_t end, unsigned) {
+        SearchWorkspace workspace(node_count);
+        std::vector<std::pair<int, float>> settled;
+        for (auto row = begin; row < end; ++row) {
+            float *distances = &m_Distances[row * Columns()];
+            hierarchy.UpwardSearch(workspace, m_Sources[row], settled);
+            for (const auto &[node, length] : settled)
+                for (int i = bucket_offsets[node]; i < bucket_offsets[node + 1]; ++i)
+                    distances[buckets[i].first] = std::min(distances[buckets[i].first], length + buckets[i].second);
+            for (std::size_t column = 0; column < Columns(); ++column)
+                if (distances[column] != infinity)
+                    distances[column] *= cost_scale;
+        }
+    });
+}
@@ -0,0 +1,43 @@
+#ifndef DISTANCE_MATRIX_H
+#define DISTANCE_MATRIX_H
+
+#include <cstddef>
+#include <vector>
+#include "route_model.h"
+
+// Shortest route costs from each of N source nodes to each of M target nodes of a RouteModel,
+// in meters for the Distance profile and in seconds for the travel time profiles. Sources
+// are processed in parallel, each on its own workspace.
+// With the profile's contraction hierarchy the targets' upward searches are run once and
+// stored in buckets, so every source needs a single upward search to fill its whole row;
+// otherwise every source runs one Dijkstra search that stops once all targets are settled.
+// Paths, if requested, always come from the Dijkstra searches.
+class DistanceMatrix {
+  public:
+    DistanceMatrix(const RouteModel &model, std::vector<int> sources, std::vector<int> targets,
+                   unsigned threads = 1, bool with_paths = false,
+                   RouteModel::Profile profile = RouteModel::Profile::Distance);
+
+    std::size_t Rows() const noexcept { return m_Sources.size(); }
+    std::size_t Columns() const noexcept { return m_Targets.size(); }
+    const std::vector<int> &Sources() const noexcept { return m_Sources; }
+    const std::vector<int> &Targets() const noexcept { return m_Targets; }
+
+    // Cost from source row to target column, or infinity if there is no route.
+    float Distance(std::size_t row, std::size_t column) const { return m_Distances[row * Columns() + column]; }
+
+    // Node indices of the route from source row to target column; empty if there is no
+    // route or paths were not requested.
+    const std::vector<int> &Path(std::size_t row, std::size_t column) const;
+
+  private:
+    void ComputeWithDijkstra(const RouteModel &model, unsigned threads, bool with_paths, RouteModel::Profile profile);
+    void ComputeWithHierarchy(const RouteModel &model, unsigned threads, RouteModel::Profile profile);
+
+    std::vector<int> m_Sources;
+    std::vector<int> m_Targets;
+    std::vector<float> m_Distances;
+    std::vector<std::vector<int>> m_Paths;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "feature_grid.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+FeatureGrid::FeatureGrid(std::vector<Box> boxes, std::size_t cell_size) : m_Boxes(std::move(boxes)) {
+    if (m_Boxes.empty())
+        return;
+
+    m_Extent = m_Boxes.front();
+    for (const auto &box : m_Boxes) {
+        m_Extent.min_x = std::min(m_Extent.min_x, box.min_x);
+        m_Extent.min_y = std::min(m_Extent.min_y, box.min_y);
+        m_Extent.max_x = std::max(m_Extent.max_x, box.max_x);
+        m_Extent.max_y = std::max(m_Extent.max_y, box.max_y);
+    }
+    const int side = std::clamp((int)std::sqrt((double)m_Boxes.size() / std::max<std::size_t>(cell_size, 1)), 1, 1024);
+    m_Columns = side;
+    m_Rows = side;
+    m_CellWidth = std::max(m_Extent.max_x - m_Extent.min_x, 1e-9f) / m_Columns;
+    m_CellHeight = std::max(m_Extent.max_y - m_Extent.min_y, 1e-9f) / m_Rows;
+
+    m_Offsets.assign((std::size_t)m_Columns * m_Rows + 1, 0);
+    auto for_each_cell = [this](const Box &box, auto fn) {
+        for (int row = Row(box.min_y); row <= Row(box.max_y); ++row)
+            for (int column = Column(box.min_x); column <= Column(box.max_x); ++column)
+                fn(row * m_Columns + column);
+    };
+    for (const auto &box : m_Boxes)
+        for_each_cell(box, [this](int cell) { m_Offsets[cell + 1]++; });
+    for (std::size_t i = 1; i < m_Offsets.size(); ++i)
+        m_Offsets[i] += m_Offsets[i - 1];
+    m_Features.resize(m_Offsets.back());
+    std::vector<int> fill(m_Offsets.begin(), m_Offsets.end() - 1);
+    for (int feature = 0; feature < (int)m_Boxes.size(); ++feature)
+        for_each_cell(m_Boxes[feature], [&](int cell) { m_Features[fill[cell]++] = feature; });
+}
+
+int FeatureGrid::Column(float x) const {
+    return std::clamp((int)std::floor((x - m_Extent.min_x) / m_CellWidth), 0, m_Columns - 1);
+}
+
+int FeatureGrid::Row(float y) const {
+    return std::clamp((int)std::floor((y - m_Extent.min_y) / m_CellHeight), 0, m_Rows - 1);
+}
+
+// A feature overlapping several visited cells is reported from the cell holding the lower
+// left corner of its intersection with the query box, which is visited exactly once.
+void FeatureGrid::Query(const Box &box, std::vector<int> &features) const {
+    features.clear();
+    if (m_Boxes.empty() || !box.Intersects(m_Extent))
+        return;
+    for (int row = Row(box.min_y); row <= Row(box.max_y); ++row)
+        for (int column = Column(box.min_x); column <= Column(box.max_x); ++column) {
+            const int cell = row * m_Columns + column;
+            for (int i = m_Offsets[cell]; i < m_Offsets[cell + 1]; ++i) {
+                const auto &feature = m_Boxes[m_Features[i]];
+                if (feature.Intersects(box) && Row(std::max(feature.min_y, box.min_y)) == row &&
+                    Column(std::max(feature.min_x, box.min_x)) == column)
+                    features.push_back(m_Features[i]);
+            }
+        }
+    std::sort(features.begin(), features.end());
+}
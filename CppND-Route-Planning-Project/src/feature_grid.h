@@ -0,0 +1,49 @@
+#ifndef FEATURE_GRID_H
+#define FEATURE_GRID_H
+
+#include <cstddef>
+#include <vector>
+
+// Uniform grid over the bounding boxes of map features, for finding the features in a
+// viewport without visiting the whole map. Every feature is listed in each cell its box
+// overlaps; a query reports a feature only from the first of its cells the query visits,
+// so queries need no scratch state and any number of threads may query one grid.
+class FeatureGrid {
+  public:
+    struct Box {
+        float min_x;
+        float min_y;
+        float max_x;
+        float max_y;
+
+        bool Intersects(const Box &other) const {
+            return min_x <= other.max_x && other.min_x <= max_x && min_y <= other.max_y && other.min_y <= max_y;
+        }
+    };
+
+    FeatureGrid() {}
+    // Feature i has bounding box boxes[i]. The grid has about cell_size features per cell.
+    explicit FeatureGrid(std::vector<Box> boxes, std::size_t cell_size = 8);
+
+    std::size_t Size() const noexcept { return m_Boxes.size(); }
+    const Box &Bounds(int feature) const { return m_Boxes[feature]; }
+
+    // Replaces features with the ids of all features whose box intersects box, ascending.
+    void Query(const Box &box, std::vector<int> &features) const;
+
+  private:
+    int Column(float x) const;
+    int Row(float y) const;
+
+    std::vector<Box> m_Boxes;
+    Box m_Extent{0.f, 0.f, 0.f, 0.f};
+    int m_Columns = 0;
+    int m_Rows = 0;
+    float m_CellWidth = 1.f;
+    float m_CellHeight = 1.f;
+    // Features of cell (row, column) in compressed sparse row form at row * m_Columns + column.
+    std::vector<int> m_Offsets;
+    std::vector<int> m_Features;
+};
+
+#endif
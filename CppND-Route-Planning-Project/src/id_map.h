@@ -0,0 +1,84 @@
+#ifndef ID_MAP_H
+#define ID_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Open-addressing hash map from 64-bit OSM ids to dense indices. Keys and values live in
+// two flat arrays probed linearly, so a lookup is a multiply-shift hash plus a few adjacent
+// loads, with no per-entry allocation.
+class IdMap {
+  public:
+    IdMap() {}
+
+    std::size_t Size() const noexcept { return m_Size; }
+
+    void Reserve(std::size_t count) {
+        std::size_t capacity = 16;
+        while (capacity < 2 * count)
+            capacity *= 2;
+        if (capacity > m_Keys.size())
+            Rehash(capacity);
+    }
+
+    // Maps id to value, replacing any previous value.
+    void Insert(std::int64_t id, int value) {
+        if (2 * (m_Size + 1) > m_Keys.size())
+            Rehash(m_Keys.empty() ? 16 : 2 * m_Keys.size());
+        auto slot = Slot(id);
+        if (m_Keys[slot] == empty_key) {
+            m_Keys[slot] = id;
+            ++m_Size;
+        }
+        m_Values[slot] = value;
+    }
+
+    // Value mapped to id, or -1 if there is none.
+    int Find(std::int64_t id) const {
+        if (m_Keys.empty())
+            return -1;
+        auto slot = Slot(id);
+        return m_Keys[slot] == empty_key ? -1 : m_Values[slot];
+    }
+
+    // Empties the map and releases its memory.
+    void Clear() {
+        m_Keys = {};
+        m_Values = {};
+        m_Size = 0;
+    }
+
+  private:
+    static constexpr std::int64_t empty_key = std::numeric_limits<std::int64_t>::min();
+
+    // Slot holding id, or the empty slot where it would be inserted.
+    std::size_t Slot(std::int64_t id) const {
+        const std::size_t mask = m_Keys.size() - 1;
+        auto slot = static_cast<std::size_t>((static_cast<std::uint64_t>(id) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+        while (m_Keys[slot] != empty_key && m_Keys[slot] != id)
+            slot = (slot + 1) & mask;
+        return slot;
+    }
+
+    void Rehash(std::size_t capacity) {
+        std::vector<std::int64_t> keys(capacity, empty_key);
+        std::vector<int> values(capacity);
+        keys.swap(m_Keys);
+        values.swap(m_Values);
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] != empty_key) {
+                auto slot = Slot(keys[i]);
+                m_Keys[slot] = keys[i];
+                m_Values[slot] = values[i];
+            }
+        }
+    }
+
+    std::vector<std::int64_t> m_Keys;
+    std::vector<int> m_Values;
+    std::size_t m_Size = 0;
+};
+
+#endif
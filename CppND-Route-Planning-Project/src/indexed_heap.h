@@ -0,0 +1,134 @@
+#ifndef INDEXED_HEAP_H
+#define INDEXED_HEAP_H
+
+#include <cstddef>
+#include <vector>
+
+// Binary min-heap over dense integer ids (e.g. node indices) with decrease-key.
+// The position of every id inside the heap is tracked, so Push, Pop and
+// DecreaseKey are all O(log n) and Contains is O(1).
+class IndexedHeap {
+  public:
+    IndexedHeap() {}
+    explicit IndexedHeap(std::size_t capacity) { Reserve(capacity); }
+
+    // Makes ids in [0, capacity) valid for this heap.
+    void Reserve(std::size_t capacity) {
+        if (capacity > m_Position.size())
+            m_Position.resize(capacity, npos);
+        m_Heap.reserve(capacity);
+    }
+
+    bool Empty() const noexcept { return m_Heap.empty(); }
+    std::size_t Size() const noexcept { return m_Heap.size(); }
+    bool Contains(int id) const { return m_Position[id] != npos; }
+    float Key(int id) const { return m_Heap[m_Position[id]].key; }
+
+    // Operation counts since the last Clear(), for search statistics.
+    std::size_t PushCount() const noexcept { return m_PushCount; }
+    std::size_t PopCount() const noexcept { return m_PopCount; }
+    std::size_t MaxSize() const noexcept { return m_MaxSize; }
+
+    int Top() const { return m_Heap.front().id; }
+    float TopKey() const { return m_Heap.front().key; }
+
+    // Inserts id with the given key, or lowers its key if already present.
+    void Push(int id, float key) {
+        if (Contains(id)) {
+            DecreaseKey(id, key);
+            return;
+        }
+        m_Position[id] = m_Heap.size();
+        m_Heap.push_back({key, id});
+        SiftUp(m_Heap.size() - 1);
+        m_PushCount++;
+        if (m_Heap.size() > m_MaxSize)
+            m_MaxSize = m_Heap.size();
+    }
+
+    // Lowers the key of an id already in the heap. Larger keys are ignored.
+    void DecreaseKey(int id, float key) {
+        auto pos = m_Position[id];
+        if (key >= m_Heap[pos].key)
+            return;
+        m_Heap[pos].key = key;
+        SiftUp(pos);
+    }
+
+    // Removes and returns the id with the smallest key.
+    int Pop() {
+        const int top = m_Heap.front().id;
+        m_Position[top] = npos;
+        m_PopCount++;
+        if (m_Heap.size() > 1) {
+            m_Heap.front() = m_Heap.back();
+            m_Position[m_Heap.front().id] = 0;
+            m_Heap.pop_back();
+            SiftDown(0);
+        }
+        else {
+            m_Heap.pop_back();
+        }
+        return top;
+    }
+
+    // Empties the heap in O(size), leaving the capacity untouched, and resets the counts.
+    void Clear() {
+        for (const auto &entry : m_Heap)
+            m_Position[entry.id] = npos;
+        m_Heap.clear();
+        m_PushCount = 0;
+        m_PopCount = 0;
+        m_MaxSize = 0;
+    }
+
+  private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    struct Entry {
+        float key;
+        int id;
+    };
+
+    void SiftUp(std::size_t pos) {
+        Entry entry = m_Heap[pos];
+        while (pos > 0) {
+            auto parent = (pos - 1) / 2;
+            if (m_Heap[parent].key <= entry.key)
+                break;
+            Place(pos, m_Heap[parent]);
+            pos = parent;
+        }
+        Place(pos, entry);
+    }
+
+    void SiftDown(std::size_t pos) {
+        Entry entry = m_Heap[pos];
+        const auto size = m_Heap.size();
+        while (true) {
+            auto child = 2 * pos + 1;
+            if (child >= size)
+                break;
+            if (child + 1 < size && m_Heap[child + 1].key < m_Heap[child].key)
+                ++child;
+            if (entry.key <= m_Heap[child].key)
+                break;
+            Place(pos, m_Heap[child]);
+            pos = child;
+        }
+        Place(pos, entry);
+    }
+
+    void Place(std::size_t pos, const Entry &entry) {
+        m_Heap[pos] = entry;
+        m_Position[entry.id] = pos;
+    }
+
+    std::vector<Entry> m_Heap;
+    std::vector<std::size_t> m_Position;
+    std::size_t m_PushCount = 0;
+    std::size_t m_PopCount = 0;
+    std::size_t m_MaxSize = 0;
+};
+
+#endif
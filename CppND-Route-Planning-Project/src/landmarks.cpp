@@ -0,0 +1,92 @@
+#include "landmarks.h"
+#include "indexed_heap.h"
+#include "map_cache.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+static constexpr float infinity = std::numeric_limits<float>::max();
+
+// Dijkstra from source over the whole graph.
+static std::vector<float> ShortestDistances(const RouteModel::Graph &graph, int source) {
+    std::vector<float> distances(graph.offsets.size() - 1, infinity);
+    IndexedHeap heap(distances.size());
+    distances[source] = 0.0f;
+    heap.Push(source, 0.0f);
+    while (!heap.Empty()) {
+        const int node = heap.Pop();
+        for (int edge = graph.offsets[node]; edge < graph.offsets[node + 1]; ++edge) {
+            const int target = graph.targets[edge];
+            if (distances[node] + graph.weights[edge] < distances[target]) {
+                distances[target] = distances[node] + graph.weights[edge];
+                heap.Push(target, distances[target]);
+            }
+        }
+    }
+    return distances;
+}
+
+
+// Each landmark is the node farthest from all landmarks chosen so far, starting from an
+// arbitrary routable node that is not a landmark itself. Landmarks then end up on the edges
+// of the map, where they give the tightest bounds for the routes passing them.
+Landmarks::Landmarks(const RouteModel::Graph &graph, std::size_t count) {
+    const int node_count = (int)graph.offsets.size() - 1;
+    int start = 0;
+    while (start < node_count && graph.offsets[start + 1] == graph.offsets[start])
+        ++start;
+    if (start == node_count)
+        return;
+
+    std::vector<std::vector<float>> distances;
+    std::vector<float> closest = ShortestDistances(graph, start);
+    while (m_Landmarks.size() < count) {
+        int farthest_node = -1;
+        float farthest = 0.0f;
+        for (int node = 0; node < node_count; ++node) {
+            if (closest[node] != infinity && closest[node] > farthest) {
+                farthest = closest[node];
+                farthest_node = node;
+            }
+        }
+        if (farthest_node < 0)
+            break;
+        m_Landmarks.push_back(farthest_node);
+        distances.push_back(ShortestDistances(graph, farthest_node));
+        for (int node = 0; node < node_count; ++node)
+            closest[node] = std::min(closest[node], distances.back()[node]);
+    }
+
+    m_Distances.resize((std::size_t)node_count * Count());
+    for (int node = 0; node < node_count; ++node)
+        for (std::size_t l = 0; l < Count(); ++l)
+            m_Distances[node * Count() + l] = distances[l][node];
+}
+
+
+Landmarks::Landmarks(MapCacheReader &cache) {
+    m_Landmarks = cache.Array<int>();
+    m_Distances = cache.Array<float>();
+    if (m_Landmarks.empty() ? !m_Distances.empty() : m_Distances.size() % m_Landmarks.size() != 0)
+        throw std::logic_error("map cache is corrupted");
+    MapCacheReader::CheckIndices(m_Landmarks, NodeCount());
+}
+
+
+void Landmarks::Save(MapCacheWriter &cache) const {
+    cache.Array(m_Landmarks);
+    cache.Array(m_Distances);
+}
+
+
+float Landmarks::LowerBound(int from, int to) const {
+    const auto count = Count();
+    const float *from_row = m_Distances.data() + from * count;
+    const float *to_row = m_Distances.data() + to * count;
+    float bound = 0.0f;
+    for (std::size_t l = 0; l < count; ++l)
+        if (from_row[l] != infinity && to_row[l] != infinity)
+            bound = std::max(bound, std::abs(from_row[l] - to_row[l]));
+    return bound;
+}
@@ -0,0 +1,37 @@
+#ifndef LANDMARKS_H
+#define LANDMARKS_H
+
+#include <cstddef>
+#include <vector>
+#include "route_model.h"
+
+class MapCacheReader;
+class MapCacheWriter;
+
+// Landmark distances for the ALT (A*, landmarks, triangle inequality) heuristic. The road
+// graph distance from every landmark to every node is precomputed; for any landmark L the
+// triangle inequality gives |d(L, a) - d(L, b)| <= d(a, b), a lower bound that, unlike the
+// straight-line distance, accounts for rivers, railways and other detours in the network.
+class Landmarks {
+  public:
+    // Picks count landmarks spread over the graph by farthest-point selection.
+    Landmarks(const RouteModel::Graph &graph, std::size_t count);
+    explicit Landmarks(MapCacheReader &cache);
+    void Save(MapCacheWriter &cache) const;
+
+    std::size_t Count() const noexcept { return m_Landmarks.size(); }
+    const std::vector<int> &Nodes() const noexcept { return m_Landmarks; }
+    // Number of graph nodes with landmark distances.
+    std::size_t NodeCount() const noexcept { return m_Landmarks.empty() ? 0 : m_Distances.size() / m_Landmarks.size(); }
+
+    // Lower bound on the road graph distance between from and to.
+    float LowerBound(int from, int to) const;
+
+  private:
+    std::vector<int> m_Landmarks;
+    // Distance from landmark l to node n at [n * Count() + l], so that the bound for a
+    // node reads one contiguous row. Unreachable nodes hold infinity.
+    std::vector<float> m_Distances;
+};
+
+#endif
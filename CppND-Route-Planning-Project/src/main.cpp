@@ -1,55 +1,126 @@
-#include <optional>
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include <string>
+#include <thread>
 #include <io2d.h>
+#include "map_cache.h"
+#include "mapped_file.h"
 #include "route_model.h"
 #include "render.h"
 #include "route_planner.h"
+#include "tile_renderer.h"
 
 using namespace std::experimental;
 
-static std::optional<std::vector<std::byte>> ReadFile(const std::string &path)
-{   
-    std::ifstream is{path, std::ios::binary | std::ios::ate};
-    if( !is )
-        return std::nullopt;
-    
-    auto size = is.tellg();
-    std::vector<std::byte> contents(size);    
-    
-    is.seekg(0);
-    is.read((char*)contents.data(), size);
-
-    if( contents.empty() )
-        return std::nullopt;
-    return std::move(contents);
+// Parses the whole of text as a number; leaves value unchanged and returns false otherwise.
+static bool ParseFloat( const char *text, float &value )
+{
+    char *end = nullptr;
+    const float parsed = std::strtof(text, &end);
+    if( end == text || *end != '\0' )
+        return false;
+    value = parsed;
+    return true;
 }
 
 int main(int argc, const char **argv)
 {    
     std::string osm_data_file = "";
+    std::string map_cache_file = "";
+    std::string stats_file = "";
+    std::string tile_directory = "";
+    int tile_max_zoom = 4;
+    bool stream_osm_data = false;
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    auto search_mode = RoutePlanner::SearchMode::AStar;
+    auto profile = RouteModel::Profile::Distance;
+    float isochrone_cost = 0.f;
+    float zoom = 1.f;
     if( argc > 1 ) {
         for( int i = 1; i < argc; ++i )
             if( std::string_view{argv[i]} == "-f" && ++i < argc )
                 osm_data_file = argv[i];
+            else if( std::string_view{argv[i]} == "-c" && ++i < argc )
+                map_cache_file = argv[i];
+            else if( std::string_view{argv[i]} == "-q" && ++i < argc )
+                stats_file = argv[i];
+            else if( std::string_view{argv[i]} == "-t" && ++i < argc )
+                tile_directory = argv[i];
+            else if( std::string_view{argv[i]} == "-tz" && ++i < argc )
+                tile_max_zoom = std::atoi(argv[i]);
+            else if( std::string_view{argv[i]} == "-s" )
+                stream_osm_data = true;
+            else if( std::string_view{argv[i]} == "-j" && ++i < argc )
+                threads = (unsigned)std::max(std::atoi(argv[i]), 1);
+            else if( std::string_view{argv[i]} == "-i" && ++i < argc ) {
+                if( !ParseFloat(argv[i], isochrone_cost) )
+                    std::cout << "Invalid isochrone distance or time: " << argv[i] << std::endl;
+            }
+            else if( std::string_view{argv[i]} == "-z" && ++i < argc ) {
+                if( ParseFloat(argv[i], zoom) )
+                    zoom = std::max(zoom, 1.f);
+                else
+                    std::cout << "Invalid zoom: " << argv[i] << std::endl;
+            }
+            else if( std::string_view{argv[i]} == "-m" && ++i < argc ) {
+                if( std::string_view{argv[i]} == "bidirectional" )
+                    search_mode = RoutePlanner::SearchMode::Bidirectional;
+                else if( std::string_view{argv[i]} == "ch" )
+                    search_mode = RoutePlanner::SearchMode::ContractionHierarchy;
+                else if( std::string_view{argv[i]} == "alt" )
+                    search_mode = RoutePlanner::SearchMode::ALT;
+                else if( std::string_view{argv[i]} == "astar" )
+                    search_mode = RoutePlanner::SearchMode::AStar;
+                else
+                    std::cout << "Unknown search mode: " << argv[i] << std::endl;
+            }
+            else if( std::string_view{argv[i]} == "-p" && ++i < argc ) {
+                if( std::string_view{argv[i]} == "car" )
+                    profile = RouteModel::Profile::Car;
+                else if( std::string_view{argv[i]} == "bike" )
+                    profile = RouteModel::Profile::Bike;
+                else if( std::string_view{argv[i]} == "foot" )
+                    profile = RouteModel::Profile::Foot;
+                else if( std::string_view{argv[i]} == "distance" )
+                    profile = RouteModel::Profile::Distance;
+                else
+                    std::cout << "Unknown profile: " << argv[i] << std::endl;
+            }
     }
     else {
         std::cout << "To specify a map file use the following format: " << std::endl;
-        std::cout << "Usage: [executable] [-f filename.osm]" << std::endl;
+        std::cout << "Usage: [executable] [-f filename.osm|filename.rmap] [-s] [-j threads] [-c filename.rmap] [-m astar|bidirectional|ch|alt] [-p distance|car|bike|foot] [-i meters|seconds] [-z zoom] [-q filename.jsonl] [-t directory] [-tz zoom]" << std::endl;
+        std::cout << "  -s  stream the map file instead of loading it into memory first" << std::endl;
+        std::cout << "  -j  number of threads used to load the map file (defaults to all cores)" << std::endl;
+        std::cout << "  -c  save the loaded map as a binary map cache for faster startup" << std::endl;
+        std::cout << "  -m  search algorithm: astar (default), bidirectional A*, ch (contraction hierarchy) or alt (A* with landmarks)" << std::endl;
+        std::cout << "  -p  routing profile: distance (default, shortest route) or the fastest route by car, bike or foot" << std::endl;
+        std::cout << "  -i  also show the area reachable from the start within the given distance, or time with -p car|bike|foot" << std::endl;
+        std::cout << "  -z  magnify the map by the given factor around the route" << std::endl;
+        std::cout << "  -q  append statistics of every query to the given file as JSON lines" << std::endl;
+        std::cout << "  -t  render the map into PNG tiles under the given directory instead of opening a window" << std::endl;
+        std::cout << "  -tz highest tile zoom level to render with -t (defaults to 4)" << std::endl;
         osm_data_file = "../map.osm";
     }
     
-    std::vector<std::byte> osm_data;
+    MappedFile osm_file;
+    std::ifstream osm_stream;
  
-    if( osm_data.empty() && !osm_data_file.empty() ) {
+    if( stream_osm_data && !osm_data_file.empty() ) {
+        std::cout << "Streaming OpenStreetMap data from the following file: " <<  osm_data_file << std::endl;
+        osm_stream.open(osm_data_file, std::ios::binary);
+        if( !osm_stream )
+            std::cout << "Failed to read." << std::endl;
+    }
+    else if( !osm_data_file.empty() ) {
         std::cout << "Reading OpenStreetMap data from the following file: " <<  osm_data_file << std::endl;
-        auto data = ReadFile(osm_data_file);
-        if( !data )
+        osm_file = MappedFile{osm_data_file};
+        if( osm_file.Empty() )
             std::cout << "Failed to read." << std::endl;
-        else
-            osm_data = std::move(*data);
     }
     
     // TODO 1: Declare floats `start_x`, `start_y`, `end_x`, and `end_y` and get
@@ -57,16 +128,82 @@ int main(int argc, const char **argv)
     // RoutePlanner object below in place of 10, 10, 90, 90.
 
     // Build Model.
-    RouteModel model{osm_data};
+    auto load_model = [&]{
+        if( stream_osm_data )
+            return RouteModel{osm_stream};
+        if( IsMapCache(osm_file) ) {
+            MapCacheReader cache{osm_file};
+            return RouteModel{cache};
+        }
+        return RouteModel{osm_file, threads};
+    };
+    RouteModel model = load_model();
+
+    if( search_mode == RoutePlanner::SearchMode::ContractionHierarchy && !model.Hierarchy(profile) ) {
+        std::cout << "Building contraction hierarchy..." << std::endl;
+        model.BuildContractionHierarchy(profile);
+    }
+    if( search_mode == RoutePlanner::SearchMode::ALT && !model.GetLandmarks(profile) ) {
+        std::cout << "Selecting landmarks..." << std::endl;
+        model.BuildLandmarks(16, profile);
+    }
 
-    // Create RoutePlanner object and perform A* search.
-    RoutePlanner route_planner{model, 10, 10, 90, 90};
-    route_planner.AStarSearch();
+    if( !map_cache_file.empty() ) {
+        std::cout << "Writing map cache to the following file: " << map_cache_file << std::endl;
+        std::ofstream os{map_cache_file, std::ios::binary};
+        MapCacheWriter cache{os};
+        model.Save(cache);
+        if( !os )
+            std::cout << "Failed to write." << std::endl;
+    }
+
+    if( !tile_directory.empty() ) {
+        std::cout << "Rendering tiles into the following directory: " << tile_directory << std::endl;
+        Render render{model};
+        TileRenderer::Options options;
+        options.directory = tile_directory;
+        options.max_zoom = tile_max_zoom;
+        options.threads = threads;
+        auto tiles = TileRenderer{model, render}.Run(options);
+        std::cout << "Tiles written: " << tiles << std::endl;
+        return 0;
+    }
+
+    // Create RoutePlanner object and perform the search.
+    RoutePlanner route_planner{model, 10, 10, 90, 90, profile};
+    route_planner.Search(search_mode);
 
+    const bool by_time = profile != RouteModel::Profile::Distance;
     std::cout << "Distance: " << route_planner.GetDistance() << " meters. \n";
+    if( by_time )
+        std::cout << "Travel time: " << route_planner.GetCost() << " seconds. \n";
+    model.path = route_planner.GetPath();
+
+    std::ofstream stats_stream;
+    if( !stats_file.empty() )
+        stats_stream.open(stats_file, std::ios::app);
+    if( stats_stream.is_open() )
+        route_planner.WriteStats(stats_stream);
+
+    if( isochrone_cost > 0.f ) {
+        route_planner.OneToAllSearch(isochrone_cost);
+        const auto &field = route_planner.GetDistanceField();
+        auto reached = std::count_if(field.begin(), field.end(), [](float d){ return d != std::numeric_limits<float>::infinity(); });
+        std::cout << "Nodes within " << isochrone_cost << (by_time ? " seconds: " : " meters: ") << reached << "\n";
+        model.isochrone = route_planner.GetIsochrone();
+        if( stats_stream.is_open() )
+            route_planner.WriteStats(stats_stream);
+    }
 
     // Render results of search.
     Render render{model};
+    if( zoom > 1.f && !model.path.empty() ) {
+        Render::Viewport viewport;
+        viewport.center_x = static_cast<float>(model.path.front().x + model.path.back().x) / 2.f;
+        viewport.center_y = static_cast<float>(model.path.front().y + model.path.back().y) / 2.f;
+        viewport.zoom = zoom;
+        render.SetViewport(viewport);
+    }
 
     auto display = io2d::output_surface{400, 400, io2d::format::argb32, io2d::scaling::none, io2d::refresh_style::fixed, 30};
     display.size_change_callback([](io2d::output_surface& surface){
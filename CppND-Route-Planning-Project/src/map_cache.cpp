@@ -0,0 +1,45 @@
+#include "map_cache.h"
+#include "mapped_file.h"
+
+static constexpr std::uint32_t kMagic = 0x50414d52; // "RMAP"
+static constexpr std::uint32_t kVersion = 5;
+static constexpr std::uint32_t kByteOrder = 0x01020304;
+
+MapCacheWriter::MapCacheWriter( std::ostream &os ):
+    m_Stream(os)
+{
+    Value(kMagic);
+    Value(kVersion);
+    Value(kByteOrder);
+}
+
+MapCacheReader::MapCacheReader( const MappedFile &file ):
+    m_Pos(file.Data()),
+    m_End(file.Data() + file.Size())
+{
+    if( !IsMapCache(file) )
+        throw std::logic_error("not a map cache file");
+    Value<std::uint32_t>();
+    if( Value<std::uint32_t>() != kVersion )
+        throw std::logic_error("unsupported map cache version");
+    if( Value<std::uint32_t>() != kByteOrder )
+        throw std::logic_error("map cache was written with a different byte order");
+}
+
+const char *MapCacheReader::Take( std::size_t size )
+{
+    if( size > (std::size_t)(m_End - m_Pos) )
+        throw std::logic_error("map cache is truncated");
+    auto data = m_Pos;
+    m_Pos += size;
+    return data;
+}
+
+bool IsMapCache( const MappedFile &file )
+{
+    std::uint32_t magic;
+    if( file.Size() < sizeof(magic) )
+        return false;
+    std::memcpy(&magic, file.Data(), sizeof(magic));
+    return magic == kMagic;
+}
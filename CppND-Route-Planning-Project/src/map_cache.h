@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class MappedFile;
+
+// Binary map cache (.rmap) format: a header followed by a sequence of values and arrays
+// of trivially copyable types, written in native byte order. Arrays are stored as an
+// element count followed by the raw elements, so loading is a bulk copy per array with
+// no parsing, projection or graph construction.
+class MapCacheWriter
+{
+public:
+    explicit MapCacheWriter( std::ostream &os );
+
+    template <typename T>
+    void Value( const T &value )
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        m_Stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void Array( const std::vector<T> &values )
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Value<std::uint64_t>(values.size());
+        m_Stream.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    // One variable-length list per item, get(item) returning the list. Stored as
+    // offsets plus one flat array.
+    template <typename Item, typename Get>
+    void Lists( const std::vector<Item> &items, Get get )
+    {
+        std::vector<std::uint64_t> offsets{0};
+        std::decay_t<decltype(get(std::declval<const Item&>()))> flat;
+        for( const auto &item: items ) {
+            const auto &list = get(item);
+            flat.insert(flat.end(), list.begin(), list.end());
+            offsets.push_back(flat.size());
+        }
+        Array(offsets);
+        Array(flat);
+    }
+
+private:
+    std::ostream &m_Stream;
+};
+
+class MapCacheReader
+{
+public:
+    // Throws if the file is not a map cache of a compatible version.
+    explicit MapCacheReader( const MappedFile &file );
+
+    template <typename T>
+    T Value()
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    std::vector<T> Array()
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto count = Value<std::uint64_t>();
+        if( count > (m_End - m_Pos) / sizeof(T) )
+            throw std::logic_error("map cache is truncated");
+        std::vector<T> values(count);
+        std::memcpy(values.data(), Take(count * sizeof(T)), count * sizeof(T));
+        return values;
+    }
+
+    // Reads lists written by MapCacheWriter::Lists, resizing items to their number and
+    // assigning each list to get(item).
+    template <typename Item, typename Get>
+    void Lists( std::vector<Item> &items, Get get )
+    {
+        using List = std::decay_t<decltype(get(std::declval<Item&>()))>;
+        const auto offsets = Array<std::uint64_t>();
+        const auto flat = Array<typename List::value_type>();
+        if( offsets.empty() )
+            throw std::logic_error("map cache is corrupted");
+        items.resize(offsets.size() - 1);
+        for( std::size_t i = 1; i < offsets.size(); ++i ) {
+            if( offsets[i - 1] > offsets[i] || offsets[i] > flat.size() )
+                throw std::logic_error("map cache is corrupted");
+            get(items[i - 1]).assign(flat.begin() + offsets[i - 1], flat.begin() + offsets[i]);
+        }
+    }
+
+    // Throw unless index lies in [0, size), for indices read from the cache that are
+    // dereferenced later.
+    static void CheckIndex( std::int64_t index, std::size_t size )
+    {
+        if( index < 0 || (std::uint64_t)index >= size )
+            throw std::logic_error("map cache is corrupted");
+    }
+
+    static void CheckIndices( const std::vector<int> &indices, std::size_t size )
+    {
+        for( auto index: indices )
+            CheckIndex(index, size);
+    }
+
+    // Throws unless offsets index a flat array of count entries: starting at 0, never
+    // decreasing and ending at count.
+    static void CheckOffsets( const std::vector<int> &offsets, std::size_t count )
+    {
+        if( offsets.empty() || offsets.front() != 0 || (std::uint64_t)offsets.back() != count )
+            throw std::logic_error("map cache is corrupted");
+        for( std::size_t i = 1; i < offsets.size(); ++i )
+            if( offsets[i - 1] > offsets[i] )
+                throw std::logic_error("map cache is corrupted");
+    }
+
+private:
+    const char *Take( std::size_t size );
+
+    const char *m_Pos = nullptr;
+    const char *m_End = nullptr;
+};
+
+// True if the file starts with the map cache header.
+bool IsMapCache( const MappedFile &file );
@@ -0,0 +1,79 @@
+#include "mapped_file.h"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile( const std::string &path )
+{
+#ifdef _WIN32
+    auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if( file == INVALID_HANDLE_VALUE )
+        return;
+    LARGE_INTEGER size;
+    if( GetFileSizeEx(file, &size) && size.QuadPart > 0 ) {
+        if( auto mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr) ) {
+            if( auto view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0) ) {
+                m_Data = static_cast<char*>(view);
+                m_Size = static_cast<std::size_t>(size.QuadPart);
+            }
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    auto fd = open(path.c_str(), O_RDONLY);
+    if( fd < 0 )
+        return;
+    struct stat st;
+    if( fstat(fd, &st) == 0 && st.st_size > 0 ) {
+        auto view = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if( view != MAP_FAILED ) {
+            m_Data = static_cast<char*>(view);
+            m_Size = static_cast<std::size_t>(st.st_size);
+        }
+    }
+    close(fd);
+#endif
+}
+
+MappedFile::MappedFile( MappedFile &&other ) noexcept:
+    m_Data(std::exchange(other.m_Data, nullptr)),
+    m_Size(std::exchange(other.m_Size, 0))
+{
+}
+
+MappedFile &MappedFile::operator=( MappedFile &&other ) noexcept
+{
+    if( this != &other ) {
+        Unmap();
+        m_Data = std::exchange(other.m_Data, nullptr);
+        m_Size = std::exchange(other.m_Size, 0);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    Unmap();
+}
+
+void MappedFile::Unmap() noexcept
+{
+    if( !m_Data )
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_Data);
+#else
+    munmap(m_Data, m_Size);
+#endif
+    m_Data = nullptr;
+    m_Size = 0;
+}
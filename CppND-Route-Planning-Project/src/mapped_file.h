@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped into memory. Pages are read lazily by the OS as they are touched,
+// so opening even a huge file is cheap. The mapping is private and copy-on-write: parsers
+// may modify the contents in place (e.g. pugixml's load_buffer_inplace) without the file
+// on disk changing, at the cost of the touched pages being copied.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile( const std::string &path );
+    MappedFile( MappedFile &&other ) noexcept;
+    MappedFile &operator=( MappedFile &&other ) noexcept;
+    MappedFile( const MappedFile & ) = delete;
+    MappedFile &operator=( const MappedFile & ) = delete;
+    ~MappedFile();
+
+    // Empty if the file could not be opened or has no contents.
+    bool Empty() const noexcept { return m_Size == 0; }
+    char *Data() noexcept { return m_Data; }
+    const char *Data() const noexcept { return m_Data; }
+    std::size_t Size() const noexcept { return m_Size; }
+
+private:
+    void Unmap() noexcept;
+
+    char *m_Data = nullptr;
+    std::size_t m_Size = 0;
+};
@@ -1,4 +1,7 @@
 #include "model.h"
+#include "map_cache.h"
+#include "mapped_file.h"
+#include "parallel_for.h"
 #include "pugixml.hpp"
 #include <iostream>
 #include <string_view>
@@ -37,145 +40,392 @@ static Model::Landuse::Type String2LanduseType(std::string_view type)
     return Model::Landuse::Invalid;
 }
 
-Model::Model( const std::vector<std::byte> &xml )
+// Lines and areas defined by ways. Filled through ClassifyWay, either directly into the
+// model or into per-thread buffers that are appended to the model in way order.
+struct WayFeatures {
+    std::vector<Model::Road> roads;
+    std::vector<Model::Railway> railways;
+    std::vector<Model::Building> buildings;
+    std::vector<Model::Leisure> leisures;
+    std::vector<Model::Water> waters;
+    std::vector<Model::Landuse> landuses;
+};
+
+template <typename Features>
+static void ClassifyWay(const OSMStreamParser::Tags &tags, int way_num, Features &features)
+{
+    for( const auto &tag: tags ) {
+        auto category = std::string_view{tag.first};
+        auto type = std::string_view{tag.second};
+        if( category == "highway" ) {
+            if( auto road_type = String2RoadType(type); road_type != Model::Road::Invalid ) {
+                features.roads.emplace_back();
+                features.roads.back().way = way_num;
+                features.roads.back().type = road_type;
+            }
+        }
+        if( category == "railway" ) {
+            features.railways.emplace_back();
+            features.railways.back().way = way_num;
+        }                
+        else if( category == "building" ) {
+            features.buildings.emplace_back();
+            features.buildings.back().outer = {way_num};
+        }
+        else if( category == "leisure" ||
+                (category == "natural" && (type == "wood"  || type == "tree_row" || type == "scrub" || type == "grassland")) ||
+                (category == "landcover" && type == "grass" ) ) {
+            features.leisures.emplace_back();
+            features.leisures.back().outer = {way_num};
+        }
+        else if( category == "natural" && type == "water" ) {
+            features.waters.emplace_back();
+            features.waters.back().outer = {way_num};
+        }
+        else if( category == "landuse" ) {
+            if( auto landuse_type = String2LanduseType(type); landuse_type != Model::Landuse::Invalid ) {
+                features.landuses.emplace_back();
+                features.landuses.back().outer = {way_num};
+                features.landuses.back().type = landuse_type;
+            }                    
+        }
+    }
+}
+
+template <typename T>
+static void Append(std::vector<T> &to, std::vector<T> &from)
+{
+    to.insert(to.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end()));
+}
+
+static void ReadWay(const pugi::xml_node &node, OSMStreamParser::Way &osm_way)
+{
+    osm_way.id = node.attribute("id").as_llong();
+    osm_way.refs.clear();
+    osm_way.tags.clear();
+    for( auto child: node.children() ) {
+        auto name = std::string_view{child.name()}; 
+        if( name == "nd" )
+            osm_way.refs.emplace_back(child.attribute("ref").as_llong());
+        else if( name == "tag" )
+            osm_way.tags.emplace_back(child.attribute("k").as_string(), child.attribute("v").as_string());
+    }
+}
+
+static void ReadRelation(const pugi::xml_node &node, OSMStreamParser::Relation &osm_relation)
+{
+    osm_relation.id = node.attribute("id").as_llong();
+    osm_relation.members.clear();
+    osm_relation.tags.clear();
+    for( auto child: node.children() ) {
+        auto name = std::string_view{child.name()}; 
+        if( name == "member" )
+            osm_relation.members.push_back({child.attribute("type").as_string(),
+                                            child.attribute("ref").as_llong(),
+                                            child.attribute("role").as_string()});
+        else if( name == "tag" )
+            osm_relation.tags.emplace_back(child.attribute("k").as_string(), child.attribute("v").as_string());
+    }
+}
+
+Model::Model( const std::vector<std::byte> &xml, unsigned threads )
+{
+    LoadData(xml, threads);
+
+    FinishLoading(threads);
+}
+
+Model::Model( MappedFile &osm_file, unsigned threads )
+{
+    LoadData(osm_file, threads);
+
+    FinishLoading(threads);
+}
+
+Model::Model( std::istream &osm )
+{
+    LoadStream(osm);
+
+    FinishLoading();
+}
+
+template <typename MP>
+static void SaveMultipolygons(MapCacheWriter &cache, const std::vector<MP> &mps)
+{
+    cache.Lists(mps, [](const MP &mp) -> const std::vector<int>& { return mp.outer; });
+    cache.Lists(mps, [](const MP &mp) -> const std::vector<int>& { return mp.inner; });
+}
+
+template <typename MP>
+static void LoadMultipolygons(MapCacheReader &cache, std::vector<MP> &mps)
+{
+    cache.Lists(mps, [](MP &mp) -> std::vector<int>& { return mp.outer; });
+    cache.Lists(mps, [](MP &mp) -> std::vector<int>& { return mp.inner; });
+}
+
+Model::Model( MapCacheReader &cache )
+{
+    m_MinLat = cache.Value<double>();
+    m_MaxLat = cache.Value<double>();
+    m_MinLon = cache.Value<double>();
+    m_MaxLon = cache.Value<double>();
+    m_MetricScale = cache.Value<double>();
+    m_HasBounds = true;
+
+    m_Nodes = cache.Array<Node>();
+    cache.Lists(m_Ways, [](Way &way) -> std::vector<int>& { return way.nodes; });
+    m_Roads = cache.Array<Road>();
+    m_Railways = cache.Array<Railway>();
+    LoadMultipolygons(cache, m_Buildings);
+    LoadMultipolygons(cache, m_Leisures);
+    LoadMultipolygons(cache, m_Waters);
+    LoadMultipolygons(cache, m_Landuses);
+    auto landuse_types = cache.Array<Landuse::Type>();
+    if( landuse_types.size() != m_Landuses.size() )
+        throw std::logic_error("map cache is corrupted");
+    for( std::size_t i = 0; i < m_Landuses.size(); ++i )
+        m_Landuses[i].type = landuse_types[i];
+
+    // Everything below is dereferenced without further checks once loaded.
+    for( const auto &way: m_Ways )
+        MapCacheReader::CheckIndices(way.nodes, m_Nodes.size());
+    for( const auto &road: m_Roads )
+        MapCacheReader::CheckIndex(road.way, m_Ways.size());
+    for( const auto &railway: m_Railways )
+        MapCacheReader::CheckIndex(railway.way, m_Ways.size());
+    auto check_mps = [this](const auto &mps) {
+        for( const auto &mp: mps ) {
+            MapCacheReader::CheckIndices(mp.outer, m_Ways.size());
+            MapCacheReader::CheckIndices(mp.inner, m_Ways.size());
+        }
+    };
+    check_mps(m_Buildings);
+    check_mps(m_Leisures);
+    check_mps(m_Waters);
+    check_mps(m_Landuses);
+}
+
+void Model::Save( MapCacheWriter &cache ) const
+{
+    cache.Value(m_MinLat);
+    cache.Value(m_MaxLat);
+    cache.Value(m_MinLon);
+    cache.Value(m_MaxLon);
+    cache.Value(m_MetricScale);
+
+    cache.Array(m_Nodes);
+    cache.Lists(m_Ways, [](const Way &way) -> const std::vector<int>& { return way.nodes; });
+    cache.Array(m_Roads);
+    cache.Array(m_Railways);
+    SaveMultipolygons(cache, m_Buildings);
+    SaveMultipolygons(cache, m_Leisures);
+    SaveMultipolygons(cache, m_Waters);
+    SaveMultipolygons(cache, m_Landuses);
+    std::vector<Landuse::Type> landuse_types;
+    for( const auto &landuse: m_Landuses )
+        landuse_types.push_back(landuse.type);
+    cache.Array(landuse_types);
+}
+
+void Model::FinishLoading(unsigned threads)
 {
-    LoadData(xml);
+    if( !m_HasBounds )
+        throw std::logic_error("map's bounds are not defined");
+
+    m_NodeIdToNum.Clear();
+    m_WayIdToNum.Clear();
 
-    AdjustCoordinates();
+    AdjustCoordinates(threads);
 
     std::sort(m_Roads.begin(), m_Roads.end(), [](const auto &_1st, const auto &_2nd){
         return (int)_1st.type < (int)_2nd.type; 
     });
 }
 
-void Model::LoadData(const std::vector<std::byte> &xml)
+void Model::LoadData(const std::vector<std::byte> &xml, unsigned threads)
 {
-    using namespace pugi;
-    
-    xml_document doc;
+    pugi::xml_document doc;
     if( !doc.load_buffer(xml.data(), xml.size()) )
         throw std::logic_error("failed to parse the xml file");
-    
+
+    LoadDocument(doc, threads);
+}
+
+void Model::LoadData(MappedFile &osm_file, unsigned threads)
+{
+    pugi::xml_document doc;
+    if( !doc.load_buffer_inplace(osm_file.Data(), osm_file.Size()) )
+        throw std::logic_error("failed to parse the xml file");
+
+    LoadDocument(doc, threads);
+}
+
+// Nodes and ways are read in parallel chunks; node and way numbers are their positions in
+// the document, and per-chunk results are merged in chunk order, so the resulting model is
+// identical for any thread count. Relations are few and read sequentially.
+void Model::LoadDocument(const pugi::xml_document &doc, unsigned threads)
+{
     if( auto bounds = doc.select_nodes("/osm/bounds"); !bounds.empty() ) {
         auto node = bounds.first().node();
-        m_MinLat = atof(node.attribute("minlat").as_string());
-        m_MaxLat = atof(node.attribute("maxlat").as_string());
-        m_MinLon = atof(node.attribute("minlon").as_string());
-        m_MaxLon = atof(node.attribute("maxlon").as_string());
+        OSMStreamParser::Bounds osm_bounds;
+        osm_bounds.min_lat = atof(node.attribute("minlat").as_string());
+        osm_bounds.max_lat = atof(node.attribute("maxlat").as_string());
+        osm_bounds.min_lon = atof(node.attribute("minlon").as_string());
+        osm_bounds.max_lon = atof(node.attribute("maxlon").as_string());
+        AddBounds(osm_bounds);
     }
-    else 
-        throw std::logic_error("map's bounds are not defined");
 
-    std::unordered_map<std::string, int> node_id_to_num;
-    for( const auto &node: doc.select_nodes("/osm/node") ) {
-        node_id_to_num[node.node().attribute("id").as_string()] = (int)m_Nodes.size();
-        m_Nodes.emplace_back();        
-        m_Nodes.back().y = atof(node.node().attribute("lat").as_string());
-        m_Nodes.back().x = atof(node.node().attribute("lon").as_string());
-    }
+    const auto nodes = doc.select_nodes("/osm/node");
+    std::vector<std::int64_t> node_ids(nodes.size());
+    m_Nodes.resize(nodes.size());
+    ParallelFor(nodes.size(), ChunkCount(nodes.size(), threads), [&](std::size_t begin, std::size_t end, unsigned) {
+        for( auto i = begin; i < end; ++i ) {
+            auto node = nodes[i].node();
+            node_ids[i] = node.attribute("id").as_llong();
+            m_Nodes[i].y = atof(node.attribute("lat").as_string());
+            m_Nodes[i].x = atof(node.attribute("lon").as_string());
+        }
+    });
+    m_NodeIdToNum.Reserve(nodes.size());
+    for( std::size_t i = 0; i < node_ids.size(); ++i )
+        m_NodeIdToNum.Insert(node_ids[i], (int)i);
 
-    std::unordered_map<std::string, int> way_id_to_num;    
-    for( const auto &way: doc.select_nodes("/osm/way") ) {
-        auto node = way.node();
-        
-        const auto way_num = (int)m_Ways.size();
-        way_id_to_num[node.attribute("id").as_string()] = way_num;
-        m_Ways.emplace_back();
-        auto &new_way = m_Ways.back();
-        
-        for( auto child: node.children() ) {
-            auto name = std::string_view{child.name()}; 
-            if( name == "nd" ) {
-                auto ref = child.attribute("ref").as_string();
-                if( auto it = node_id_to_num.find(ref); it != end(node_id_to_num) )
-                    new_way.nodes.emplace_back(it->second);
-            }
-            else if( name == "tag" ) {
-                auto category = std::string_view{child.attribute("k").as_string()};
-                auto type = std::string_view{child.attribute("v").as_string()};
-                if( category == "highway" ) {
-                    if( auto road_type = String2RoadType(type); road_type != Road::Invalid ) {
-                        m_Roads.emplace_back();
-                        m_Roads.back().way = way_num;
-                        m_Roads.back().type = road_type;
-                    }
-                }
-                if( category == "railway" ) {
-                    m_Railways.emplace_back();
-                    m_Railways.back().way = way_num;
-                }                
-                else if( category == "building" ) {
-                    m_Buildings.emplace_back();
-                    m_Buildings.back().outer = {way_num};
-                }
-                else if( category == "leisure" ||
-                        (category == "natural" && (type == "wood"  || type == "tree_row" || type == "scrub" || type == "grassland")) ||
-                        (category == "landcover" && type == "grass" ) ) {
-                    m_Leisures.emplace_back();
-                    m_Leisures.back().outer = {way_num};
-                }
-                else if( category == "natural" && type == "water" ) {
-                    m_Waters.emplace_back();
-                    m_Waters.back().outer = {way_num};
-                }
-                else if( category == "landuse" ) {
-                    if( auto landuse_type = String2LanduseType(type); landuse_type != Landuse::Invalid ) {
-                        m_Landuses.emplace_back();
-                        m_Landuses.back().outer = {way_num};
-                        m_Landuses.back().type = landuse_type;
-                    }                    
-                }
-            }
+    const auto ways = doc.select_nodes("/osm/way");
+    const auto chunks = ChunkCount(ways.size(), threads);
+    std::vector<std::int64_t> way_ids(ways.size());
+    std::vector<WayFeatures> features(chunks);
+    m_Ways.resize(ways.size());
+    ParallelFor(ways.size(), chunks, [&](std::size_t begin, std::size_t end, unsigned chunk) {
+        OSMStreamParser::Way osm_way;
+        for( auto i = begin; i < end; ++i ) {
+            ReadWay(ways[i].node(), osm_way);
+            way_ids[i] = osm_way.id;
+            ResolveWayNodes(osm_way, m_Ways[i]);
+            ClassifyWay(osm_way.tags, (int)i, features[chunk]);
         }
+    });
+    m_WayIdToNum.Reserve(ways.size());
+    for( std::size_t i = 0; i < way_ids.size(); ++i )
+        m_WayIdToNum.Insert(way_ids[i], (int)i);
+    for( auto &chunk_features: features ) {
+        Append(m_Roads, chunk_features.roads);
+        Append(m_Railways, chunk_features.railways);
+        Append(m_Buildings, chunk_features.buildings);
+        Append(m_Leisures, chunk_features.leisures);
+        Append(m_Waters, chunk_features.waters);
+        Append(m_Landuses, chunk_features.landuses);
     }
-    
+
+    OSMStreamParser::Relation osm_relation;
     for( const auto &relation: doc.select_nodes("/osm/relation") ) {
-        auto node = relation.node();
-        auto noode_id = std::string_view{node.attribute("id").as_string()};
-        std::vector<int> outer, inner;
-        auto commit = [&](Multipolygon &mp) {
-            mp.outer = std::move(outer);
-            mp.inner = std::move(inner);
-        };
-        for( auto child: node.children() ) {
-            auto name = std::string_view{child.name()}; 
-            if( name == "member" ) {
-                if( std::string_view{child.attribute("type").as_string()} == "way" ) {
-                    if( !way_id_to_num.count(child.attribute("ref").as_string()) )
-                        continue;
-                    auto way_num = way_id_to_num[child.attribute("ref").as_string()];
-                    if( std::string_view{child.attribute("role").as_string()} == "outer" )
-                        outer.emplace_back(way_num);
-                    else
-                        inner.emplace_back(way_num);
-                }
-            }
-            else if( name == "tag" ) { 
-                auto category = std::string_view{child.attribute("k").as_string()};
-                auto type = std::string_view{child.attribute("v").as_string()};
-                if( category == "building" ) {
-                    commit( m_Buildings.emplace_back() );
-                    break;
-                }
-                if( category == "natural" && type == "water" ) {
-                    commit( m_Waters.emplace_back() );
-                    BuildRings(m_Waters.back());
-                    break;
-                }
-                if( category == "landuse" ) {
-                    if( auto landuse_type = String2LanduseType(type); landuse_type != Landuse::Invalid ) {
-                        commit( m_Landuses.emplace_back() );
-                        m_Landuses.back().type = landuse_type;
-                        BuildRings(m_Landuses.back());
-                    }
-                    break;
-                }
+        ReadRelation(relation.node(), osm_relation);
+        AddRelation(osm_relation);
+    }
+}
+
+void Model::LoadStream(std::istream &osm)
+{
+    struct Handler : OSMStreamParser::Handler {
+        Model &model;
+        Handler(Model &model) : model(model) {}
+        void OnBounds(const OSMStreamParser::Bounds &bounds) override { model.AddBounds(bounds); }
+        void OnNode(const OSMStreamParser::Node &node) override { model.AddNode(node); }
+        void OnWay(const OSMStreamParser::Way &way) override { model.AddWay(way); }
+        void OnRelation(const OSMStreamParser::Relation &relation) override { model.AddRelation(relation); }
+    } handler{*this};
+
+    OSMStreamParser parser{handler};
+    parser.Parse(osm);
+}
+
+void Model::AddBounds(const OSMStreamParser::Bounds &bounds)
+{
+    if( m_HasBounds )
+        return;
+    m_MinLat = bounds.min_lat;
+    m_MaxLat = bounds.max_lat;
+    m_MinLon = bounds.min_lon;
+    m_MaxLon = bounds.max_lon;
+    m_HasBounds = true;
+}
+
+void Model::AddNode(const OSMStreamParser::Node &node)
+{
+    m_NodeIdToNum.Insert(node.id, (int)m_Nodes.size());
+    m_Nodes.emplace_back();
+    m_Nodes.back().y = node.lat;
+    m_Nodes.back().x = node.lon;
+}
+
+void Model::AddWay(const OSMStreamParser::Way &way)
+{
+    const auto way_num = (int)m_Ways.size();
+    m_WayIdToNum.Insert(way.id, way_num);
+    ResolveWayNodes(way, m_Ways.emplace_back());
+
+    struct {
+        std::vector<Road> &roads;
+        std::vector<Railway> &railways;
+        std::vector<Building> &buildings;
+        std::vector<Leisure> &leisures;
+        std::vector<Water> &waters;
+        std::vector<Landuse> &landuses;
+    } features{m_Roads, m_Railways, m_Buildings, m_Leisures, m_Waters, m_Landuses};
+    ClassifyWay(way.tags, way_num, features);
+}
+
+void Model::ResolveWayNodes(const OSMStreamParser::Way &way, Way &new_way) const
+{
+    new_way.nodes.clear();
+    new_way.nodes.reserve(way.refs.size());
+    for( auto ref: way.refs )
+        if( auto node_num = m_NodeIdToNum.Find(ref); node_num >= 0 )
+            new_way.nodes.emplace_back(node_num);
+}
+
+void Model::AddRelation(const OSMStreamParser::Relation &relation)
+{
+    std::vector<int> outer, inner;
+    for( const auto &member: relation.members ) {
+        if( member.type != "way" )
+            continue;
+        auto way_num = m_WayIdToNum.Find(member.ref);
+        if( way_num < 0 )
+            continue;
+        if( member.role == "outer" )
+            outer.emplace_back(way_num);
+        else
+            inner.emplace_back(way_num);
+    }
+
+    auto commit = [&](Multipolygon &mp) {
+        mp.outer = std::move(outer);
+        mp.inner = std::move(inner);
+    };
+    for( const auto &tag: relation.tags ) {
+        auto category = std::string_view{tag.first};
+        auto type = std::string_view{tag.second};
+        if( category == "building" ) {
+            commit( m_Buildings.emplace_back() );
+            break;
+        }
+        if( category == "natural" && type == "water" ) {
+            commit( m_Waters.emplace_back() );
+            BuildRings(m_Waters.back());
+            break;
+        }
+        if( category == "landuse" ) {
+            if( auto landuse_type = String2LanduseType(type); landuse_type != Landuse::Invalid ) {
+                commit( m_Landuses.emplace_back() );
+                m_Landuses.back().type = landuse_type;
+                BuildRings(m_Landuses.back());
             }
+            break;
         }
     }
 }
 
-void Model::AdjustCoordinates()
+void Model::AdjustCoordinates(unsigned threads)
 {    
     const auto pi = 3.14159265358979323846264338327950288;
     const auto deg_to_rad = 2. * pi / 360.;
@@ -187,10 +437,13 @@ void Model::AdjustCoordinates()
     const auto min_y = lat2ym(m_MinLat);
     const auto min_x = lon2xm(m_MinLon);
     m_MetricScale = std::min(dx, dy);
-    for( auto &node: m_Nodes ) {
-        node.x = (lon2xm(node.x) - min_x) / m_MetricScale;
-        node.y = (lat2ym(node.y) - min_y) / m_MetricScale;        
-    }
+    ParallelFor(m_Nodes.size(), ChunkCount(m_Nodes.size(), threads), [&](std::size_t begin, std::size_t end, unsigned) {
+        for( auto i = begin; i < end; ++i ) {
+            auto &node = m_Nodes[i];
+            node.x = (lon2xm(node.x) - min_x) / m_MetricScale;
+            node.y = (lat2ym(node.y) - min_y) / m_MetricScale;        
+        }
+    });
 }
 
 static bool TrackRec(const std::vector<int> &open_ways,
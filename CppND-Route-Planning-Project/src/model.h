@@ -4,6 +4,14 @@
 #include <unordered_map>
 #include <string>
 #include <cstddef>
+#include <iosfwd>
+#include "id_map.h"
+#include "osm_stream_parser.h"
+
+class MappedFile;
+class MapCacheReader;
+class MapCacheWriter;
+namespace pugi { class xml_document; }
 
 class Model
 {
@@ -44,7 +52,16 @@ public:
         Type type;
     };
     
-    Model( const std::vector<std::byte> &xml );
+    // Loading from an XML buffer or mapped file reads nodes and ways and projects
+    // coordinates on up to threads threads; the model is the same for any thread count.
+    Model( const std::vector<std::byte> &xml, unsigned threads = 1 );
+    // Parses the mapped file in place, without copying it. Consumes the mapping's contents.
+    Model( MappedFile &osm_file, unsigned threads = 1 );
+    // Streaming mode: parses the OSM XML in a single pass without building a DOM.
+    Model( std::istream &osm );
+    // Loads a model previously written by Save, without any parsing or projection.
+    Model( MapCacheReader &cache );
+    void Save( MapCacheWriter &cache ) const;
     
     auto MetricScale() const noexcept { return m_MetricScale; }    
     
@@ -58,9 +75,18 @@ public:
     auto &Railways() const noexcept { return m_Railways; }
     
 private:
-    void AdjustCoordinates();
+    void AdjustCoordinates(unsigned threads = 1);
     void BuildRings( Multipolygon &mp );
-    void LoadData(const std::vector<std::byte> &xml);
+    void LoadData(const std::vector<std::byte> &xml, unsigned threads);
+    void LoadData(MappedFile &osm_file, unsigned threads);
+    void LoadDocument(const pugi::xml_document &doc, unsigned threads);
+    void LoadStream(std::istream &osm);
+    void FinishLoading(unsigned threads = 1);
+    void AddBounds(const OSMStreamParser::Bounds &bounds);
+    void AddNode(const OSMStreamParser::Node &node);
+    void AddWay(const OSMStreamParser::Way &way);
+    void ResolveWayNodes(const OSMStreamParser::Way &way, Way &new_way) const;
+    void AddRelation(const OSMStreamParser::Relation &relation);
     
     std::vector<Node> m_Nodes;
     std::vector<Way> m_Ways;
@@ -76,4 +102,9 @@ private:
     double m_MinLon = 0.;
     double m_MaxLon = 0.;
     double m_MetricScale = 1.f;
+    bool m_HasBounds = false;
+
+    // OSM id lookups, only needed while loading.
+    IdMap m_NodeIdToNum;
+    IdMap m_WayIdToNum;
 };
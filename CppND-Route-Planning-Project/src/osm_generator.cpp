@@ -0,0 +1,220 @@
+#include "osm_generator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+
+// Grid spacing of roughly 50 m at the generated latitudes.
+static constexpr double base_latitude = 52.0;
+static constexpr double base_longitude = 13.0;
+static constexpr double latitude_step = 0.00045;
+static constexpr double longitude_step = 0.00073;
+
+struct OsmGenerator::Feature {
+    enum Kind { Street, Building };
+    Kind kind;
+    const char *type;
+    // Street from intersection (row, column) to (to_row, to_column), or the block whose
+    // corner is (row, column) for a building.
+    double row;
+    double column;
+    double to_row;
+    double to_column;
+    std::uint64_t from_id;
+    std::uint64_t to_id;
+    // Ids of the shape or corner nodes, first_id .. first_id + node_count - 1.
+    std::uint64_t first_id;
+    int node_count;
+};
+
+OsmGenerator::OsmGenerator(Options options) : m_Options(options) {
+    // Nodes per intersection: the intersection itself plus the shape nodes of its two
+    // streets, and for cities its share of footways and buildings.
+    double nodes_per_intersection = 1.0;
+    switch (m_Options.layout) {
+        case Layout::Grid:
+            nodes_per_intersection = 3.0;
+            break;
+        case Layout::RandomPlanar:
+            nodes_per_intersection = 1.0;
+            break;
+        case Layout::City:
+            nodes_per_intersection = 7.9;
+            break;
+    }
+    m_Size = std::max<std::uint64_t>(2, (std::uint64_t)std::sqrt((double)m_Options.nodes / nodes_per_intersection));
+}
+
+std::optional<OsmGenerator::Layout> OsmGenerator::ParseLayout(std::string_view name) {
+    if (name == "grid")
+        return Layout::Grid;
+    if (name == "random")
+        return Layout::RandomPlanar;
+    if (name == "city")
+        return Layout::City;
+    return std::nullopt;
+}
+
+double OsmGenerator::Latitude(double row) const {
+    return base_latitude + row * latitude_step;
+}
+
+double OsmGenerator::Longitude(double column) const {
+    return base_longitude + column * longitude_step;
+}
+
+// SplitMix64 of the seed and a feature's coordinates, so that any random choice can be
+// recomputed in either pass without keeping state.
+std::uint64_t OsmGenerator::Random(std::uint64_t a, std::uint64_t b, std::uint64_t c) const {
+    std::uint64_t z = m_Options.seed;
+    for (auto value : {a, b, c}) {
+        z += value + 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+    }
+    return z;
+}
+
+double OsmGenerator::Uniform(std::uint64_t a, std::uint64_t b, std::uint64_t c) const {
+    return (Random(a, b, c) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Road type of the grid line at index i in a city: motorways every 64 lines, then primary,
+// secondary and tertiary roads every 16, 8 and 4 lines.
+static const char *CityRoadType(std::uint64_t i) {
+    if (i % 64 == 32)
+        return "motorway";
+    if (i % 16 == 0)
+        return "primary";
+    if (i % 8 == 0)
+        return "secondary";
+    if (i % 4 == 0)
+        return "tertiary";
+    return "residential";
+}
+
+template <typename Fn>
+void OsmGenerator::ForEachFeature(Fn fn) const {
+    const std::uint64_t n = m_Size;
+    std::uint64_t next_id = n * n + 1;
+    auto intersection = [n](std::uint64_t i, std::uint64_t j) { return i * n + j + 1; };
+    auto street = [&](std::uint64_t i, std::uint64_t j, std::uint64_t to_i, std::uint64_t to_j, const char *type,
+                      int shape_nodes) {
+        fn(Feature{Feature::Street, type, (double)i, (double)j, (double)to_i, (double)to_j, intersection(i, j),
+                   intersection(to_i, to_j), next_id, shape_nodes});
+        next_id += shape_nodes;
+    };
+
+    for (std::uint64_t i = 0; i < n; ++i)
+        for (std::uint64_t j = 0; j < n; ++j) {
+            const bool last_row = i + 1 == n;
+            const bool last_column = j + 1 == n;
+            switch (m_Options.layout) {
+                case Layout::Grid:
+                    if (!last_column)
+                        street(i, j, i, j + 1, i % 10 == 0 ? "primary" : "residential", 1);
+                    if (!last_row)
+                        street(i, j, i + 1, j, j % 10 == 0 ? "primary" : "residential", 1);
+                    break;
+                case Layout::RandomPlanar: {
+                    static const char *types[] = {"residential", "residential", "unclassified", "tertiary", "secondary"};
+                    if (!last_column && Uniform(i, j, 0) < 0.8)
+                        street(i, j, i, j + 1, types[Random(i, j, 1) % 5], 0);
+                    if (!last_row && Uniform(i, j, 2) < 0.8)
+                        street(i, j, i + 1, j, types[Random(i, j, 3) % 5], 0);
+                    // At most one diagonal per cell keeps the network planar.
+                    if (!last_row && !last_column && Uniform(i, j, 4) < 0.3) {
+                        if (Random(i, j, 5) & 1)
+                            street(i, j, i + 1, j + 1, "residential", 0);
+                        else
+                            street(i, j + 1, i + 1, j, "residential", 0);
+                    }
+                    break;
+                }
+                case Layout::City:
+                    if (!last_column)
+                        street(i, j, i, j + 1, CityRoadType(i), 2);
+                    if (!last_row)
+                        street(i, j, i + 1, j, CityRoadType(j), 2);
+                    if (!last_row && !last_column) {
+                        if (Uniform(i, j, 0) < 0.15)
+                            street(i, j, i + 1, j + 1, "footway", 1);
+                        else if (Uniform(i, j, 1) < 0.8) {
+                            fn(Feature{Feature::Building, "yes", (double)i, (double)j, (double)i + 1, (double)j + 1, 0, 0,
+                                       next_id, 4});
+                            next_id += 4;
+                        }
+                    }
+                    break;
+            }
+        }
+}
+
+void OsmGenerator::Write(std::ostream &os) const {
+    const std::uint64_t n = m_Size;
+    // Intersections are jittered by at most a fifth of the spacing, which keeps streets from
+    // crossing, and by less where the layout should stay regular.
+    const double jitter = m_Options.layout == Layout::RandomPlanar ? 0.2 : m_Options.layout == Layout::City ? 0.1 : 0.05;
+    auto offset = [&](std::uint64_t i, std::uint64_t j, std::uint64_t axis) {
+        return (Uniform(i, j, 100 + axis) - 0.5) * 2.0 * jitter;
+    };
+    auto row_of = [&](double i, double j) { return i + offset((std::uint64_t)i, (std::uint64_t)j, 0); };
+    auto column_of = [&](double i, double j) { return j + offset((std::uint64_t)i, (std::uint64_t)j, 1); };
+
+    char line[128];
+    auto node = [&](std::uint64_t id, double row, double column) {
+        const int length = std::snprintf(line, sizeof(line), "<node id=\"%llu\" lat=\"%.7f\" lon=\"%.7f\"/>\n",
+                                         (unsigned long long)id, Latitude(row), Longitude(column));
+        os.write(line, length);
+    };
+
+    os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<osm version=\"0.6\" generator=\"generate_map\">\n";
+    std::snprintf(line, sizeof(line), "<bounds minlat=\"%.7f\" minlon=\"%.7f\" maxlat=\"%.7f\" maxlon=\"%.7f\"/>\n",
+                  Latitude(-1.0), Longitude(-1.0), Latitude((double)n), Longitude((double)n));
+    os << line;
+
+    for (std::uint64_t i = 0; i < n; ++i)
+        for (std::uint64_t j = 0; j < n; ++j)
+            node(i * n + j + 1, row_of(i, j), column_of(i, j));
+
+    // Shape nodes lie on the straight line between the jittered intersections, bent
+    // sideways on city streets; building corners are inset from the block's corners.
+    ForEachFeature([&](const Feature &feature) {
+        if (feature.kind == Feature::Building) {
+            const double inset = 0.3;
+            const double corners[4][2] = {{inset, inset}, {inset, 1 - inset}, {1 - inset, 1 - inset}, {1 - inset, inset}};
+            for (int k = 0; k < 4; ++k)
+                node(feature.first_id + k, feature.row + corners[k][0], feature.column + corners[k][1]);
+            return;
+        }
+        const double from_row = row_of(feature.row, feature.column), from_column = column_of(feature.row, feature.column);
+        const double to_row = row_of(feature.to_row, feature.to_column), to_column = column_of(feature.to_row, feature.to_column);
+        const double bend = m_Options.layout == Layout::City ? 0.08 : 0.0;
+        for (int k = 0; k < feature.node_count; ++k) {
+            const double t = (k + 1.0) / (feature.node_count + 1.0);
+            const double side = bend * std::sin(t * 3.14159265358979);
+            node(feature.first_id + k, from_row + (to_row - from_row) * t + side * (to_column - from_column),
+                 from_column + (to_column - from_column) * t - side * (to_row - from_row));
+        }
+    });
+
+    std::uint64_t way_id = 1;
+    ForEachFeature([&](const Feature &feature) {
+        os << "<way id=\"" << way_id++ << "\">";
+        auto ref = [&](std::uint64_t id) { os << "<nd ref=\"" << id << "\"/>"; };
+        if (feature.kind == Feature::Building) {
+            for (int k = 0; k < 4; ++k)
+                ref(feature.first_id + k);
+            ref(feature.first_id);
+            os << "<tag k=\"building\" v=\"" << feature.type << "\"/></way>\n";
+            return;
+        }
+        ref(feature.from_id);
+        for (int k = 0; k < feature.node_count; ++k)
+            ref(feature.first_id + k);
+        ref(feature.to_id);
+        os << "<tag k=\"highway\" v=\"" << feature.type << "\"/></way>\n";
+    });
+    os << "</osm>\n";
+}
@@ -0,0 +1,60 @@
+#ifndef OSM_GENERATOR_H
+#define OSM_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string_view>
+
+// Synthetic road networks for scale testing, written as OSM XML that Model loads like any
+// extract. Output is streamed while it is generated and the generator keeps no per-node
+// state, so maps of 10^8 nodes need no more memory than small ones. The same options
+// always produce the same map.
+class OsmGenerator {
+  public:
+    enum class Layout {
+        // Square grid of residential streets with a primary road on every tenth line.
+        Grid,
+        // Jittered grid with random streets removed and random diagonals added; no two
+        // streets cross outside a node.
+        RandomPlanar,
+        // Grid with a road hierarchy from motorways to residential streets, curved street
+        // segments, footways across some blocks and a building on most blocks.
+        City
+    };
+
+    struct Options {
+        Layout layout = Layout::Grid;
+        // Approximate total number of nodes, intersections, shape and building nodes included.
+        std::uint64_t nodes = 10000;
+        std::uint64_t seed = 1;
+    };
+
+    explicit OsmGenerator(Options options);
+
+    // Intersections along each side of the grid underlying the layout.
+    std::uint64_t GridSize() const noexcept { return m_Size; }
+
+    // Writes the whole map, bounds, nodes and ways, as OSM XML.
+    void Write(std::ostream &os) const;
+
+    static std::optional<Layout> ParseLayout(std::string_view name);
+
+  private:
+    // A street segment or building of the layout, numbered so that both passes over the
+    // features, one writing nodes and one writing ways, agree on every node id.
+    struct Feature;
+    template <typename Fn>
+    void ForEachFeature(Fn fn) const;
+
+    double Latitude(double row) const;
+    double Longitude(double column) const;
+    std::uint64_t Random(std::uint64_t a, std::uint64_t b, std::uint64_t c) const;
+    double Uniform(std::uint64_t a, std::uint64_t b, std::uint64_t c) const;
+
+    Options m_Options;
+    std::uint64_t m_Size = 0;
+};
+
+#endif
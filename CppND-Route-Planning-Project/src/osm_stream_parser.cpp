@@ -0,0 +1,280 @@
+#include "osm_stream_parser.h"
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+
+static bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void AppendUTF8(std::string &out, unsigned long code)
+{
+    if( code < 0x80 )
+        out += (char)code;
+    else if( code < 0x800 ) {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+    else if( code < 0x10000 ) {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+    else {
+        out += (char)(0xF0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3F));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+}
+
+// Copies an attribute value into out, replacing character entities.
+static void DecodeValue(std::string_view raw, std::string &out)
+{
+    out.clear();
+    for( std::size_t i = 0; i < raw.size(); ) {
+        auto amp = raw.find('&', i);
+        out.append(raw.substr(i, amp - i));
+        if( amp == std::string_view::npos )
+            break;
+        auto semicolon = raw.find(';', amp);
+        if( semicolon == std::string_view::npos ) {
+            out.append(raw.substr(amp));
+            break;
+        }
+        auto entity = raw.substr(amp + 1, semicolon - amp - 1);
+        if( entity == "amp" )       out += '&';
+        else if( entity == "lt" )   out += '<';
+        else if( entity == "gt" )   out += '>';
+        else if( entity == "quot" ) out += '"';
+        else if( entity == "apos" ) out += '\'';
+        else if( !entity.empty() && entity[0] == '#' ) {
+            auto hex = entity.size() > 1 && (entity[1] == 'x' || entity[1] == 'X');
+            auto digits = std::string{entity.substr(hex ? 2 : 1)};
+            AppendUTF8(out, std::strtoul(digits.c_str(), nullptr, hex ? 16 : 10));
+        }
+        else
+            out.append(raw.substr(amp, semicolon - amp + 1));
+        i = semicolon + 1;
+    }
+}
+
+void OSMStreamParser::Feed(const char *data, std::size_t size)
+{
+    const char *end = data + size;
+
+    // Complete the markup left over from the previous chunk, one '>' at a time since
+    // a '>' may also appear inside a quoted attribute value.
+    while( !m_Carry.empty() && data != end ) {
+        auto gt = static_cast<const char*>(std::memchr(data, '>', end - data));
+        auto take_end = gt ? gt + 1 : end;
+        m_Carry.append(data, take_end);
+        data = take_end;
+        auto stop = ParseRange(m_Carry.data(), m_Carry.data() + m_Carry.size());
+        m_Carry.erase(0, stop - m_Carry.data());
+    }
+
+    if( data != end ) {
+        auto stop = ParseRange(data, end);
+        m_Carry.assign(stop, end);
+    }
+}
+
+void OSMStreamParser::Finish()
+{
+    for( auto c: m_Carry )
+        if( !IsSpace(c) )
+            throw std::logic_error("unexpected end of the osm data");
+    if( m_Element != Element::None )
+        throw std::logic_error("unexpected end of the osm data");
+    m_Carry.clear();
+}
+
+void OSMStreamParser::Parse(std::istream &is, std::size_t chunk_size)
+{
+    std::vector<char> chunk(chunk_size);
+    while( is ) {
+        is.read(chunk.data(), chunk.size());
+        if( is.gcount() > 0 )
+            Feed(chunk.data(), (std::size_t)is.gcount());
+    }
+    Finish();
+}
+
+const char *OSMStreamParser::ParseRange(const char *begin, const char *end)
+{
+    while( begin != end ) {
+        auto lt = static_cast<const char*>(std::memchr(begin, '<', end - begin));
+        if( !lt )
+            return end;
+        auto next = ParseMarkup(lt, end);
+        if( !next )
+            return lt;
+        begin = next;
+    }
+    return end;
+}
+
+const char *OSMStreamParser::ParseMarkup(const char *begin, const char *end)
+{
+    auto text = std::string_view{begin, (std::size_t)(end - begin)};
+    auto skip_past = [&](std::string_view terminator) -> const char* {
+        auto pos = text.find(terminator, 2);
+        return pos == std::string_view::npos ? nullptr : begin + pos + terminator.size();
+    };
+
+    if( text.size() < 2 )
+        return nullptr;
+    if( text[1] == '?' )
+        return skip_past("?>");
+    if( text[1] == '!' ) {
+        auto is_prefix_of = [&](std::string_view markup) {
+            return text.size() < markup.size() && markup.substr(0, text.size()) == text;
+        };
+        if( is_prefix_of("<!--") || is_prefix_of("<![CDATA[") )
+            return nullptr;
+        if( text.substr(0, 4) == "<!--" )
+            return skip_past("-->");
+        if( text.substr(0, 9) == "<![CDATA[" )
+            return skip_past("]]>");
+        return skip_past(">");
+    }
+    if( text[1] == '/' ) {
+        auto gt = text.find('>', 2);
+        if( gt == std::string_view::npos )
+            return nullptr;
+        auto name = text.substr(2, gt - 2);
+        while( !name.empty() && IsSpace(name.back()) )
+            name.remove_suffix(1);
+        EndElement(name);
+        return begin + gt + 1;
+    }
+
+    // Start tag: name, then attributes until '>' or '/>'.
+    std::size_t pos = 1;
+    while( pos < text.size() && !IsSpace(text[pos]) && text[pos] != '>' && text[pos] != '/' )
+        ++pos;
+    auto name = text.substr(1, pos - 1);
+    m_AttributeCount = 0;
+    while( true ) {
+        while( pos < text.size() && IsSpace(text[pos]) )
+            ++pos;
+        if( pos >= text.size() )
+            return nullptr;
+        if( text[pos] == '>' ) {
+            StartElement(name, false);
+            return begin + pos + 1;
+        }
+        if( text[pos] == '/' ) {
+            if( pos + 1 >= text.size() )
+                return nullptr;
+            StartElement(name, true);
+            return begin + pos + 2;
+        }
+
+        auto eq = text.find('=', pos);
+        if( eq == std::string_view::npos )
+            return nullptr;
+        auto key = text.substr(pos, eq - pos);
+        while( !key.empty() && IsSpace(key.back()) )
+            key.remove_suffix(1);
+        auto quote = text.find_first_of("\"'", eq + 1);
+        if( quote == std::string_view::npos )
+            return nullptr;
+        auto closing = text.find(text[quote], quote + 1);
+        if( closing == std::string_view::npos )
+            return nullptr;
+
+        if( m_AttributeCount == m_Attributes.size() )
+            m_Attributes.emplace_back();
+        auto &attribute = m_Attributes[m_AttributeCount++];
+        attribute.first = key;
+        DecodeValue(text.substr(quote + 1, closing - quote - 1), attribute.second);
+        pos = closing + 1;
+    }
+}
+
+const std::string &OSMStreamParser::Attribute(std::string_view key) const
+{
+    static const std::string empty;
+    for( std::size_t i = 0; i < m_AttributeCount; ++i )
+        if( m_Attributes[i].first == key )
+            return m_Attributes[i].second;
+    return empty;
+}
+
+std::int64_t OSMStreamParser::IdAttribute(std::string_view key) const
+{
+    const auto &value = Attribute(key);
+    std::int64_t id = 0;
+    std::from_chars(value.data(), value.data() + value.size(), id);
+    return id;
+}
+
+void OSMStreamParser::StartElement(std::string_view name, bool self_closing)
+{
+    if( name == "node" ) {
+        m_Node.id = IdAttribute("id");
+        m_Node.lat = std::atof(Attribute("lat").c_str());
+        m_Node.lon = std::atof(Attribute("lon").c_str());
+        if( self_closing )
+            m_Handler.OnNode(m_Node);
+        else
+            m_Element = Element::Node;
+    }
+    else if( name == "way" ) {
+        m_Way.id = IdAttribute("id");
+        m_Way.refs.clear();
+        m_Way.tags.clear();
+        if( self_closing )
+            m_Handler.OnWay(m_Way);
+        else
+            m_Element = Element::Way;
+    }
+    else if( name == "relation" ) {
+        m_Relation.id = IdAttribute("id");
+        m_Relation.members.clear();
+        m_Relation.tags.clear();
+        if( self_closing )
+            m_Handler.OnRelation(m_Relation);
+        else
+            m_Element = Element::Relation;
+    }
+    else if( name == "nd" ) {
+        if( m_Element == Element::Way )
+            m_Way.refs.emplace_back(IdAttribute("ref"));
+    }
+    else if( name == "member" ) {
+        if( m_Element == Element::Relation )
+            m_Relation.members.push_back({Attribute("type"), IdAttribute("ref"), Attribute("role")});
+    }
+    else if( name == "tag" ) {
+        if( m_Element == Element::Way )
+            m_Way.tags.emplace_back(Attribute("k"), Attribute("v"));
+        else if( m_Element == Element::Relation )
+            m_Relation.tags.emplace_back(Attribute("k"), Attribute("v"));
+    }
+    else if( name == "bounds" ) {
+        m_Bounds.min_lat = std::atof(Attribute("minlat").c_str());
+        m_Bounds.max_lat = std::atof(Attribute("maxlat").c_str());
+        m_Bounds.min_lon = std::atof(Attribute("minlon").c_str());
+        m_Bounds.max_lon = std::atof(Attribute("maxlon").c_str());
+        m_Handler.OnBounds(m_Bounds);
+    }
+}
+
+void OSMStreamParser::EndElement(std::string_view name)
+{
+    if( name == "node" && m_Element == Element::Node )
+        m_Handler.OnNode(m_Node);
+    else if( name == "way" && m_Element == Element::Way )
+        m_Handler.OnWay(m_Way);
+    else if( name == "relation" && m_Element == Element::Relation )
+        m_Handler.OnRelation(m_Relation);
+    else
+        return;
+    m_Element = Element::None;
+}
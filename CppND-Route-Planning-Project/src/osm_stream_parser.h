@@ -0,0 +1,101 @@
+#ifndef OSM_STREAM_PARSER_H
+#define OSM_STREAM_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Single-pass SAX-style reader for OSM XML. Input is fed in chunks of any size and every
+// bounds, node, way and relation element is handed to the Handler as soon as its closing
+// tag has been read, so memory use is bounded by the largest element instead of the file.
+// Only the subset of XML found in OSM files is understood: elements, attributes, comments,
+// processing instructions and the predefined/numeric character entities. Element ids and
+// references are parsed as 64-bit integers; a missing or malformed one reads as 0.
+class OSMStreamParser {
+  public:
+    using Tags = std::vector<std::pair<std::string, std::string>>;
+
+    struct Bounds {
+        double min_lat = 0.;
+        double min_lon = 0.;
+        double max_lat = 0.;
+        double max_lon = 0.;
+    };
+
+    struct Node {
+        std::int64_t id = 0;
+        double lat = 0.;
+        double lon = 0.;
+    };
+
+    struct Way {
+        std::int64_t id = 0;
+        std::vector<std::int64_t> refs;
+        Tags tags;
+    };
+
+    struct Member {
+        std::string type;
+        std::int64_t ref = 0;
+        std::string role;
+    };
+
+    struct Relation {
+        std::int64_t id = 0;
+        std::vector<Member> members;
+        Tags tags;
+    };
+
+    // Elements are only valid for the duration of the callback.
+    class Handler {
+      public:
+        virtual ~Handler() = default;
+        virtual void OnBounds(const Bounds &/*bounds*/) {}
+        virtual void OnNode(const Node &/*node*/) {}
+        virtual void OnWay(const Way &/*way*/) {}
+        virtual void OnRelation(const Relation &/*relation*/) {}
+    };
+
+    explicit OSMStreamParser(Handler &handler) : m_Handler(handler) {}
+
+    // Parses the next chunk of the document. Markup split across chunks is carried over.
+    void Feed(const char *data, std::size_t size);
+
+    // Signals the end of input; throws if the document ended inside markup.
+    void Finish();
+
+    // Feeds the whole stream in fixed-size chunks and finishes.
+    void Parse(std::istream &is, std::size_t chunk_size = 1 << 20);
+
+  private:
+    enum class Element { None, Bounds, Node, Way, Relation };
+
+    // Parses the markup starting at '<' in [begin, end). Returns the position after it,
+    // or nullptr if the markup is not complete yet.
+    const char *ParseMarkup(const char *begin, const char *end);
+    // Parses as much of [begin, end) as possible and returns where parsing stopped.
+    const char *ParseRange(const char *begin, const char *end);
+    void StartElement(std::string_view name, bool self_closing);
+    void EndElement(std::string_view name);
+    const std::string &Attribute(std::string_view key) const;
+    std::int64_t IdAttribute(std::string_view key) const;
+
+    Handler &m_Handler;
+    std::string m_Carry;
+
+    // Attributes of the start tag currently being processed.
+    std::vector<std::pair<std::string_view, std::string>> m_Attributes;
+    std::size_t m_AttributeCount = 0;
+
+    Element m_Element = Element::None;
+    Bounds m_Bounds;
+    Node m_Node;
+    Way m_Way;
+    Relation m_Relation;
+};
+
+#endif
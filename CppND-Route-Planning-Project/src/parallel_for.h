@@ -0,0 +1,29 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Splits [0, count) into contiguous chunks and runs fn(begin, end, chunk) for each chunk on
+// its own thread. Chunks are in order, so per-chunk results can be merged deterministically.
+template <typename Fn>
+void ParallelFor(std::size_t count, unsigned chunks, Fn fn) {
+    if (chunks <= 1) {
+        fn(std::size_t{0}, count, 0u);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (unsigned chunk = 0; chunk < chunks; ++chunk)
+        workers.emplace_back(fn, count * chunk / chunks, count * (chunk + 1) / chunks, chunk);
+    for (auto &worker : workers)
+        worker.join();
+}
+
+// One chunk per thread, but no empty chunks.
+inline unsigned ChunkCount(std::size_t count, unsigned threads) {
+    return (unsigned)std::clamp<std::size_t>(count, 1, std::max(threads, 1u));
+}
+
+#endif
@@ -1,9 +1,16 @@
 #include "render.h"
+#include "simplify.h"
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <optional>
 
 static float RoadMetricWidth(Model::Road::Type type);
 static io2d::rgba_color RoadColor(Model::Road::Type type);
 static io2d::dashes RoadDashes(Model::Road::Type type);
+static float RoadMinPixelsInMeter(Model::Road::Type type);
+static double LevelTolerance(int level);
 static io2d::point_2d ToPoint2D( const Model::Node &node ) noexcept; 
 
 Render::Render( RouteModel &model ):
@@ -11,27 +18,94 @@ Render::Render( RouteModel &model ):
 {
     BuildRoadReps();
     BuildLanduseBrushes();
+    BuildLayers();
+    BuildRoadLists();
+    BuildSimplifiedWays();
 }
 
 void Render::Display( io2d::output_surface &surface )
 {
-    m_Scale = static_cast<float>(std::min(surface.dimensions().x(), surface.dimensions().y()));    
-    m_PixelsInMeter = static_cast<float>(m_Scale / m_Model.MetricScale()); 
-    m_Matrix = io2d::matrix_2d::create_scale({m_Scale, -m_Scale}) *
-               io2d::matrix_2d::create_translate({0.f, static_cast<float>(surface.dimensions().y())});
+    const auto width = surface.dimensions().x();
+    const auto height = surface.dimensions().y();
+    SetupFrame(m_Frame, width, height, m_Viewport);
+    if( width != m_Width || height != m_Height || m_Viewport.center_x != m_LastViewport.center_x ||
+        m_Viewport.center_y != m_LastViewport.center_y || m_Viewport.zoom != m_LastViewport.zoom ) {
+        ++m_Generation;
+        m_Width = width;
+        m_Height = height;
+        m_LastViewport = m_Viewport;
+    }
+    CollectLayers(m_Frame, [this](int kind, int feature, auto make_path) {
+        auto &layer = m_Layers[kind];
+        if( layer.path_generations[feature] != m_Generation ) {
+            layer.paths[feature] = make_path();
+            layer.path_generations[feature] = m_Generation;
+        }
+        return layer.paths[feature];
+    }, [this](int list, auto make_path) {
+        if( m_RoadPathGenerations[list] != m_Generation ) {
+            m_RoadPaths[list] = make_path();
+            m_RoadPathGenerations[list] = m_Generation;
+        }
+        return m_RoadPaths[list];
+    });
     
     surface.paint(m_BackgroundFillBrush);        
-    DrawLanduses(surface);
-    DrawLeisure(surface);
-    DrawWater(surface);    
-    DrawRailways(surface);
-    DrawHighways(surface);    
-    DrawBuildings(surface);  
+    DrawMap(surface, m_Frame);
+    DrawIsochrone(surface);
     DrawPath(surface);
     DrawStartPosition(surface);   
     DrawEndPosition(surface);
 }
 
+void Render::DrawImage( io2d::image_surface &surface, const Viewport &viewport ) const
+{
+    Frame frame;
+    SetupFrame(frame, surface.dimensions().x(), surface.dimensions().y(), viewport);
+    CollectLayers(frame, [](int, int, auto make_path) { return make_path(); },
+                  [](int, auto make_path) { return make_path(); });
+
+    surface.paint(m_BackgroundFillBrush);
+    DrawMap(surface, frame);
+}
+
+void Render::SetViewport( const Viewport &viewport )
+{
+    m_Viewport = viewport;
+    m_Viewport.zoom = std::max(m_Viewport.zoom, 1e-3f);
+}
+
+void Render::SetupFrame(Frame &frame, int width, int height, const Viewport &viewport) const
+{
+    frame.scale = static_cast<float>(std::min(width, height)) * viewport.zoom;
+    frame.pixels_in_meter = static_cast<float>(frame.scale / m_Model.MetricScale()); 
+    frame.matrix = io2d::matrix_2d::create_translate({-viewport.center_x, -viewport.center_y}) *
+                   io2d::matrix_2d::create_scale({frame.scale, -frame.scale}) *
+                   io2d::matrix_2d::create_translate({width / 2.f, height / 2.f});
+    frame.level = -1;
+    while( frame.level + 1 < lod_levels && LevelTolerance(frame.level + 1) <= 0.5 / frame.scale )
+        ++frame.level;
+
+    // The visible part of the map in model coordinates, widened by a margin so that strokes
+    // of features just outside the surface still reach into it.
+    const float margin = 16.f / frame.scale;
+    const float half_width = width / 2.f / frame.scale + margin;
+    const float half_height = height / 2.f / frame.scale + margin;
+    frame.view = {viewport.center_x - half_width, viewport.center_y - half_height,
+                  viewport.center_x + half_width, viewport.center_y + half_height};
+}
+
+template <typename Surface>
+void Render::DrawMap(Surface &surface, const Frame &frame) const
+{
+    DrawLanduses(surface, frame);
+    DrawLeisure(surface, frame);
+    DrawWater(surface, frame);    
+    DrawRailways(surface, frame);
+    DrawHighways(surface, frame);    
+    DrawBuildings(surface, frame);  
+}
+
 void Render::DrawPath(io2d::output_surface &surface) const{
     io2d::render_props aliased{ io2d::antialias::none };
     io2d::brush foreBrush{ io2d::rgba_color::orange}; 
@@ -40,13 +114,30 @@ void Render::DrawPath(io2d::output_surface &surface) const{
 
 }
 
+void Render::DrawIsochrone(io2d::output_surface &surface) const
+{
+    if( m_Model.isochrone.size() < 3 )
+        return;
+
+    auto pb = io2d::path_builder{};
+    pb.matrix(m_Frame.matrix);
+    pb.new_figure( ToPoint2D(m_Model.isochrone.front()) );
+    for( auto it = ++m_Model.isochrone.begin(); it != std::end(m_Model.isochrone); ++it )
+        pb.line( ToPoint2D(*it) );
+    pb.close_figure();
+
+    auto path = io2d::interpreted_path{pb};
+    surface.fill(m_IsochroneFillBrush, path);
+    surface.stroke(m_IsochroneOutlineBrush, path, std::nullopt, m_IsochroneOutlineStrokeProps);
+}
+
 void Render::DrawEndPosition(io2d::output_surface &surface) const{
     if (m_Model.path.empty()) return;
     io2d::render_props aliased{ io2d::antialias::none };
     io2d::brush foreBrush{ io2d::rgba_color::red };
 
     auto pb = io2d::path_builder{}; 
-    pb.matrix(m_Matrix);
+    pb.matrix(m_Frame.matrix);
 
     pb.new_figure({(float) m_Model.path.back().x, (float) m_Model.path.back().y});
     float constexpr l_marker = 0.01f;
@@ -67,7 +158,7 @@ void Render::DrawStartPosition(io2d::output_surface &surface) const{
     io2d::brush foreBrush{ io2d::rgba_color::green };
 
     auto pb = io2d::path_builder{}; 
-    pb.matrix(m_Matrix);
+    pb.matrix(m_Frame.matrix);
 
     pb.new_figure({(float) m_Model.path.front().x, (float) m_Model.path.front().y});
     float constexpr l_marker = 0.01f;
@@ -81,58 +172,59 @@ void Render::DrawStartPosition(io2d::output_surface &surface) const{
     surface.stroke(foreBrush, io2d::interpreted_path{pb}, std::nullopt, std::nullopt, std::nullopt, aliased);
 }
 
-void Render::DrawBuildings(io2d::output_surface &surface) const
+template <typename Surface>
+void Render::DrawBuildings(Surface &surface, const Frame &frame) const
 {
-    for( auto &building: m_Model.Buildings() ) {
-        auto path = PathFromMP(building);
+    for( auto &path: frame.paths[BuildingLayer] ) {
         surface.fill(m_BuildingFillBrush, path);        
         surface.stroke(m_BuildingOutlineBrush, path, std::nullopt, m_BuildingOutlineStrokeProps);
     }
 }
 
-void Render::DrawLeisure(io2d::output_surface &surface) const
+template <typename Surface>
+void Render::DrawLeisure(Surface &surface, const Frame &frame) const
 {
-    for( auto &leisure: m_Model.Leisures()) {
-        auto path = PathFromMP(leisure);
+    for( auto &path: frame.paths[LeisureLayer] ) {
         surface.fill(m_LeisureFillBrush, path);        
         surface.stroke(m_LeisureOutlineBrush, path, std::nullopt, m_LeisureOutlineStrokeProps);
     }
 }
 
-void Render::DrawWater(io2d::output_surface &surface) const
+template <typename Surface>
+void Render::DrawWater(Surface &surface, const Frame &frame) const
 {
-    for( auto &water: m_Model.Waters())
-        surface.fill(m_WaterFillBrush, PathFromMP(water));
+    for( auto &path: frame.paths[WaterLayer] )
+        surface.fill(m_WaterFillBrush, path);
 }
 
-void Render::DrawLanduses(io2d::output_surface &surface) const
+template <typename Surface>
+void Render::DrawLanduses(Surface &surface, const Frame &frame) const
 {
-    for( auto &landuse: m_Model.Landuses() )
-        if( auto br = m_LanduseBrushes.find(landuse.type); br != m_LanduseBrushes.end() )        
-            surface.fill(br->second, PathFromMP(landuse));
+    auto &landuses = m_Model.Landuses();
+    auto &visible = frame.visible[LanduseLayer];
+    for( size_t i = 0; i < visible.size(); ++i )
+        if( auto br = m_LanduseBrushes.find(landuses[visible[i]].type); br != m_LanduseBrushes.end() )        
+            surface.fill(br->second, frame.paths[LanduseLayer][i]);
 }
 
-void Render::DrawHighways(io2d::output_surface &surface) const
+template <typename Surface>
+void Render::DrawHighways(Surface &surface, const Frame &frame) const
 {
-    auto ways = m_Model.Ways().data();
-    for( auto road: m_Model.Roads() )
-        if( auto rep_it = m_RoadReps.find(road.type); rep_it != m_RoadReps.end() ) {
-            auto &rep = rep_it->second;   
-            auto &way = ways[road.way];
-            auto width = rep.metric_width > 0.f ? (rep.metric_width * m_PixelsInMeter) : 1.f;
+    for( size_t i = 0; i < m_RoadLists.size(); ++i )
+        if( !frame.visible_roads[i].empty() ) {
+            auto &rep = *m_RoadLists[i].rep;   
+            auto width = rep.metric_width > 0.f ? (rep.metric_width * frame.pixels_in_meter) : 1.f;
             auto sp = io2d::stroke_props{width, io2d::line_cap::round};
-            surface.stroke(rep.brush, PathFromWay(way), std::nullopt, sp, rep.dashes);        
+            surface.stroke(rep.brush, frame.road_paths[i], std::nullopt, sp, rep.dashes);        
         }
 }
 
-void Render::DrawRailways(io2d::output_surface &surface) const
+template <typename Surface>
+void Render::DrawRailways(Surface &surface, const Frame &frame) const
 {     
-    auto ways = m_Model.Ways().data();
-    for( auto &railway: m_Model.Railways() ) {
-        auto &way = ways[railway.way];
-        auto path = PathFromWay(way);
-        surface.stroke(m_RailwayStrokeBrush, path, std::nullopt, io2d::stroke_props{m_RailwayOuterWidth * m_PixelsInMeter});
-        surface.stroke(m_RailwayDashBrush, path, std::nullopt, io2d::stroke_props{m_RailwayInnerWidth * m_PixelsInMeter}, m_RailwayDashes);
+    for( auto &path: frame.paths[RailwayLayer] ) {
+        surface.stroke(m_RailwayStrokeBrush, path, std::nullopt, io2d::stroke_props{m_RailwayOuterWidth * frame.pixels_in_meter});
+        surface.stroke(m_RailwayDashBrush, path, std::nullopt, io2d::stroke_props{m_RailwayInnerWidth * frame.pixels_in_meter}, m_RailwayDashes);
     }
 }
 
@@ -144,7 +236,7 @@ io2d::interpreted_path Render::PathLine() const
     const auto nodes = m_Model.path;    
     
     auto pb = io2d::path_builder{};
-    pb.matrix(m_Matrix);
+    pb.matrix(m_Frame.matrix);
     pb.new_figure( ToPoint2D( m_Model.path[0]));
 
     for( int i=1; i< m_Model.path.size();i++ )
@@ -154,7 +246,7 @@ io2d::interpreted_path Render::PathLine() const
     return io2d::interpreted_path{pb};
 }
 
-io2d::interpreted_path Render::PathFromWay(const Model::Way &way) const
+io2d::interpreted_path Render::PathFromWay(const Frame &frame, const Model::Way &way) const
 {    
     if( way.nodes.empty() )
         return {};
@@ -162,20 +254,20 @@ io2d::interpreted_path Render::PathFromWay(const Model::Way &way) const
     const auto nodes = m_Model.Nodes().data();    
     
     auto pb = io2d::path_builder{};
-    pb.matrix(m_Matrix);
+    pb.matrix(frame.matrix);
     pb.new_figure( ToPoint2D(nodes[way.nodes.front()]) );
     for( auto it = ++way.nodes.begin(); it != std::end(way.nodes); ++it )
         pb.line( ToPoint2D(nodes[*it]) );     
     return io2d::interpreted_path{pb};
 }
 
-io2d::interpreted_path Render::PathFromMP(const Model::Multipolygon &mp) const
+io2d::interpreted_path Render::PathFromMP(const Frame &frame, const Model::Multipolygon &mp) const
 {
     const auto nodes = m_Model.Nodes().data();
-    const auto ways = m_Model.Ways().data();
+    const auto ways = LevelWays(frame).data();
 
     auto pb = io2d::path_builder{};    
-    pb.matrix(m_Matrix);    
+    pb.matrix(frame.matrix);    
     
     auto commit = [&](const Model::Way &way) {
         if( way.nodes.empty() )
@@ -194,6 +286,177 @@ io2d::interpreted_path Render::PathFromMP(const Model::Multipolygon &mp) const
     return io2d::interpreted_path{pb};
 }
 
+io2d::interpreted_path Render::PathFromRoads(const Frame &frame, const RoadList &list, const std::vector<int> &visible) const
+{
+    const auto nodes = m_Model.Nodes().data();
+    const auto ways = LevelWays(frame).data();
+    const auto roads = m_Model.Roads().data();
+
+    auto pb = io2d::path_builder{};
+    pb.matrix(frame.matrix);
+    for( auto i: visible ) {
+        auto &way = ways[roads[list.roads[i]].way];
+        if( way.nodes.empty() )
+            continue;
+        pb.new_figure( ToPoint2D(nodes[way.nodes.front()]) );
+        for( auto it = ++way.nodes.begin(); it != std::end(way.nodes); ++it )
+            pb.line( ToPoint2D(nodes[*it]) );
+    }
+    return io2d::interpreted_path{pb};
+}
+
+FeatureGrid::Box Render::WayBox(const Model::Way &way) const
+{
+    if( way.nodes.empty() )
+        return {0.f, 0.f, 0.f, 0.f};
+
+    auto &nodes = m_Model.Nodes();
+    FeatureGrid::Box box{std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                         std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    for( auto node_num: way.nodes ) {
+        box.min_x = std::min(box.min_x, static_cast<float>(nodes[node_num].x));
+        box.min_y = std::min(box.min_y, static_cast<float>(nodes[node_num].y));
+        box.max_x = std::max(box.max_x, static_cast<float>(nodes[node_num].x));
+        box.max_y = std::max(box.max_y, static_cast<float>(nodes[node_num].y));
+    }
+    return box;
+}
+
+FeatureGrid::Box Render::MPBox(const Model::Multipolygon &mp) const
+{
+    auto &ways = m_Model.Ways();
+    std::optional<FeatureGrid::Box> box;
+    for( auto &way_nums: {std::cref(mp.outer), std::cref(mp.inner)} )
+        for( auto way_num: way_nums.get() ) {
+            if( ways[way_num].nodes.empty() )
+                continue;
+            auto way_box = WayBox(ways[way_num]);
+            if( !box )
+                box = way_box;
+            box->min_x = std::min(box->min_x, way_box.min_x);
+            box->min_y = std::min(box->min_y, way_box.min_y);
+            box->max_x = std::max(box->max_x, way_box.max_x);
+            box->max_y = std::max(box->max_y, way_box.max_y);
+        }
+    return box.value_or(FeatureGrid::Box{0.f, 0.f, 0.f, 0.f});
+}
+
+void Render::BuildLayers()
+{
+    auto &ways = m_Model.Ways();
+    auto from_mps = [this](auto &mps, Layer &layer) {
+        std::vector<FeatureGrid::Box> boxes;
+        boxes.reserve(mps.size());
+        for( auto &mp: mps )
+            boxes.push_back(MPBox(mp));
+        layer.grid = FeatureGrid{std::move(boxes)};
+    };
+    from_mps(m_Model.Landuses(), m_Layers[LanduseLayer]);
+    from_mps(m_Model.Leisures(), m_Layers[LeisureLayer]);
+    from_mps(m_Model.Waters(), m_Layers[WaterLayer]);
+    from_mps(m_Model.Buildings(), m_Layers[BuildingLayer]);
+
+    auto from_ways = [&](auto &features, Layer &layer) {
+        std::vector<FeatureGrid::Box> boxes;
+        boxes.reserve(features.size());
+        for( auto &feature: features )
+            boxes.push_back(WayBox(ways[feature.way]));
+        layer.grid = FeatureGrid{std::move(boxes)};
+    };
+    from_ways(m_Model.Railways(), m_Layers[RailwayLayer]);
+
+    for( auto &layer: m_Layers ) {
+        layer.paths.resize(layer.grid.Size());
+        layer.path_generations.assign(layer.grid.Size(), 0);
+    }
+}
+
+void Render::BuildRoadLists()
+{
+    using R = Model::Road;
+    auto &roads = m_Model.Roads();
+    auto &ways = m_Model.Ways();
+    auto types = {R::Footway, R::Service, R::Unclassified, R::Residential, R::Tertiary,
+        R::Secondary, R::Primary, R::Trunk, R::Motorway};
+    for( auto type: types ) {
+        RoadList list;
+        list.rep = &m_RoadReps.at(type);
+        std::vector<FeatureGrid::Box> boxes;
+        for( int i = 0; i < (int)roads.size(); ++i )
+            if( roads[i].type == type ) {
+                list.roads.push_back(i);
+                boxes.push_back(WayBox(ways[roads[i].way]));
+            }
+        if( list.roads.empty() )
+            continue;
+        list.grid = FeatureGrid{std::move(boxes)};
+        m_RoadLists.push_back(std::move(list));
+    }
+    m_RoadPaths.resize(m_RoadLists.size());
+    m_RoadPathGenerations.assign(m_RoadLists.size(), 0);
+}
+
+void Render::BuildSimplifiedWays()
+{
+    auto &nodes = m_Model.Nodes();
+    for( int level = 0; level < lod_levels; ++level ) {
+        // Each level simplifies the one before, which is much shorter than the full geometry.
+        auto &source = level == 0 ? m_Model.Ways() : m_SimplifiedWays[level - 1];
+        auto &ways = m_SimplifiedWays[level];
+        ways.reserve(source.size());
+        for( auto &way: source )
+            ways.push_back(SimplifyWay(nodes, way, LevelTolerance(level)));
+    }
+}
+
+const std::vector<Model::Way> &Render::LevelWays(const Frame &frame) const
+{
+    return frame.level < 0 ? m_Model.Ways() : m_SimplifiedWays[frame.level];
+}
+
+// Fills the layers of frame with the features in its view that are large enough to see,
+// taking the path of each from get_path(kind, feature, make_path), and the road lists with
+// the merged path of the roads in view from get_road_path(list, make_path).
+template <typename GetPath, typename GetRoadPath>
+void Render::CollectLayers(Frame &frame, GetPath get_path, GetRoadPath get_road_path) const
+{
+    auto &ways = LevelWays(frame);
+    const float min_size = m_MinFeaturePixels / frame.scale;
+    auto query = [&](const FeatureGrid &grid, std::vector<int> &visible) {
+        grid.Query(frame.view, visible);
+        visible.erase(std::remove_if(visible.begin(), visible.end(), [&](int i) {
+            auto &box = grid.Bounds(i);
+            return box.max_x - box.min_x < min_size && box.max_y - box.min_y < min_size;
+        }), visible.end());
+    };
+    auto collect = [&](int kind, auto make_path) {
+        auto &visible = frame.visible[kind];
+        auto &paths = frame.paths[kind];
+        query(m_Layers[kind].grid, visible);
+        paths.clear();
+        paths.reserve(visible.size());
+        for( auto i: visible )
+            paths.push_back(get_path(kind, i, [&]{ return make_path(i); }));
+    };
+    collect(LanduseLayer, [&](int i){ return PathFromMP(frame, m_Model.Landuses()[i]); });
+    collect(LeisureLayer, [&](int i){ return PathFromMP(frame, m_Model.Leisures()[i]); });
+    collect(WaterLayer, [&](int i){ return PathFromMP(frame, m_Model.Waters()[i]); });
+    collect(BuildingLayer, [&](int i){ return PathFromMP(frame, m_Model.Buildings()[i]); });
+    collect(RailwayLayer, [&](int i){ return PathFromWay(frame, ways[m_Model.Railways()[i].way]); });
+
+    frame.visible_roads.resize(m_RoadLists.size());
+    frame.road_paths.resize(m_RoadLists.size());
+    for( size_t i = 0; i < m_RoadLists.size(); ++i ) {
+        auto &list = m_RoadLists[i];
+        auto &visible = frame.visible_roads[i];
+        visible.clear();
+        if( frame.pixels_in_meter >= list.rep->min_pixels_in_meter )
+            query(list.grid, visible);
+        if( !visible.empty() )
+            frame.road_paths[i] = get_road_path((int)i, [&]{ return PathFromRoads(frame, list, visible); });
+    }
+}
+
 void Render::BuildRoadReps()
 {
     using R = Model::Road;
@@ -204,6 +467,7 @@ void Render::BuildRoadReps()
         rep.brush = io2d::brush{ RoadColor(type) };
         rep.metric_width = RoadMetricWidth(type);  
         rep.dashes = RoadDashes(type);
+        rep.min_pixels_in_meter = RoadMinPixelsInMeter(type);
     }
 }
 
@@ -255,6 +519,25 @@ static io2d::dashes RoadDashes(Model::Road::Type type)
     return type == Model::Road::Footway ? io2d::dashes{0.f, {1.f, 2.f}} : io2d::dashes{};   
 }
 
+// Minor roads are left out of zoomed out frames, where they would only blur together.
+static float RoadMinPixelsInMeter(Model::Road::Type type)
+{
+    switch( type ) {
+        case Model::Road::Residential:  return 0.05f;
+        case Model::Road::Unclassified: return 0.05f;
+        case Model::Road::Service:      return 0.1f;
+        case Model::Road::Footway:      return 0.1f;
+        default:                        return 0.f;
+    }
+}
+
+// Simplification tolerance of a level in model coordinates, from 1/32768 of the map for
+// level 0 up to 1/512 for the coarsest level.
+static double LevelTolerance(int level)
+{
+    return (1 << (2 * level)) / 32768.;
+}
+
 static io2d::point_2d ToPoint2D( const Model::Node &node ) noexcept
 {
     return io2d::point_2d(static_cast<float>(node.x), static_cast<float>(node.y));
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
 #include <unordered_map>
+#include <vector>
 #include <io2d.h>
+#include "feature_grid.h"
 #include "route_model.h"
 
 using namespace std::experimental;
@@ -9,31 +12,118 @@ using namespace std::experimental;
 class Render
 {
 public:
+    // Part of the map on screen: the normalized map point at the center of the surface
+    // and the magnification, where 1 fits the whole map into the surface.
+    struct Viewport {
+        float center_x = 0.5f;
+        float center_y = 0.5f;
+        float zoom = 1.f;
+    };
+
     Render(RouteModel &model );
     void Display( io2d::output_surface &surface );
+    // Draws the map part shown by viewport into surface, without the route or any other
+    // overlay. Keeps no state, so any number of threads may draw at once.
+    void DrawImage( io2d::image_surface &surface, const Viewport &viewport ) const;
+
+    const Viewport &GetViewport() const noexcept { return m_Viewport; }
+    void SetViewport( const Viewport &viewport );
     
 private:
+    enum LayerKind { LanduseLayer, LeisureLayer, WaterLayer, RailwayLayer, BuildingLayer, layer_count };
+
+    struct RoadRep {
+        io2d::brush brush{io2d::rgba_color::black};
+        io2d::dashes dashes{};
+        float metric_width = 1.f;
+        // Roads of this type are not drawn while a meter is fewer pixels than this.
+        float min_pixels_in_meter = 0.f;
+    };
+
+    // Draw list of the roads of one type, which share a representation and are stroked
+    // together in a single path. Feature i of grid is road roads[i] of the model.
+    struct RoadList {
+        const RoadRep *rep = nullptr;
+        FeatureGrid grid;
+        std::vector<int> roads;
+    };
+
+    // Grid locating the features of one kind, and the paths Display last built for them,
+    // valid while path_generations[feature] equals m_Generation.
+    struct Layer {
+        FeatureGrid grid;
+        std::vector<io2d::interpreted_path> paths;
+        std::vector<unsigned> path_generations;
+    };
+
+    // One drawing of the map: the surface transform, the simplification level and, for each
+    // layer, the features in view with their paths in the same order.
+    struct Frame {
+        float scale = 1.f;
+        float pixels_in_meter = 1.f;
+        io2d::matrix_2d matrix;
+        int level = -1;
+        FeatureGrid::Box view{0.f, 0.f, 0.f, 0.f};
+        std::array<std::vector<int>, layer_count> visible;
+        std::array<std::vector<io2d::interpreted_path>, layer_count> paths;
+        // Per road list, the roads in view and one path of all of them.
+        std::vector<std::vector<int>> visible_roads;
+        std::vector<io2d::interpreted_path> road_paths;
+    };
+
     void BuildRoadReps();
     void BuildLanduseBrushes();
+    void BuildLayers();
+    void BuildRoadLists();
+    void BuildSimplifiedWays();
+    const std::vector<Model::Way> &LevelWays(const Frame &frame) const;
+    void SetupFrame(Frame &frame, int width, int height, const Viewport &viewport) const;
+    template <typename GetPath, typename GetRoadPath>
+    void CollectLayers(Frame &frame, GetPath get_path, GetRoadPath get_road_path) const;
+    FeatureGrid::Box WayBox(const Model::Way &way) const;
+    FeatureGrid::Box MPBox(const Model::Multipolygon &mp) const;
     
-    void DrawBuildings(io2d::output_surface &surface) const;
-    void DrawHighways(io2d::output_surface &surface) const;
-    void DrawRailways(io2d::output_surface &surface) const;
-    void DrawLeisure(io2d::output_surface &surface) const;
-    void DrawWater(io2d::output_surface &surface) const;
-    void DrawLanduses(io2d::output_surface &surface) const;
+    template <typename Surface> void DrawMap(Surface &surface, const Frame &frame) const;
+    template <typename Surface> void DrawBuildings(Surface &surface, const Frame &frame) const;
+    template <typename Surface> void DrawHighways(Surface &surface, const Frame &frame) const;
+    template <typename Surface> void DrawRailways(Surface &surface, const Frame &frame) const;
+    template <typename Surface> void DrawLeisure(Surface &surface, const Frame &frame) const;
+    template <typename Surface> void DrawWater(Surface &surface, const Frame &frame) const;
+    template <typename Surface> void DrawLanduses(Surface &surface, const Frame &frame) const;
     void DrawStartPosition(io2d::output_surface &surface) const;
     void DrawEndPosition(io2d::output_surface &surface) const;
     void DrawPath(io2d::output_surface &surface) const;
-    io2d::interpreted_path PathFromWay(const Model::Way &way) const;
-    io2d::interpreted_path PathFromMP(const Model::Multipolygon &mp) const;
+    void DrawIsochrone(io2d::output_surface &surface) const;
+    io2d::interpreted_path PathFromWay(const Frame &frame, const Model::Way &way) const;
+    io2d::interpreted_path PathFromMP(const Frame &frame, const Model::Multipolygon &mp) const;
+    io2d::interpreted_path PathFromRoads(const Frame &frame, const RoadList &list, const std::vector<int> &visible) const;
     io2d::interpreted_path PathLine() const;
 
     
     RouteModel &m_Model;
-    float m_Scale = 1.f;
-    float m_PixelsInMeter = 1.f;
-    io2d::matrix_2d m_Matrix;
+    Viewport m_Viewport;
+    std::array<Layer, layer_count> m_Layers;
+    // Road draw lists from the least to the most important road type, in drawing order,
+    // with the merged paths Display last built for them, valid like the layer paths.
+    std::vector<RoadList> m_RoadLists;
+    std::vector<io2d::interpreted_path> m_RoadPaths;
+    std::vector<unsigned> m_RoadPathGenerations;
+
+    // The frame Display drew last. Its paths come from the layer caches, which are
+    // invalidated by incrementing m_Generation whenever the surface transform changes.
+    Frame m_Frame;
+    unsigned m_Generation = 0;
+    int m_Width = -1;
+    int m_Height = -1;
+    Viewport m_LastViewport;
+
+    // Douglas-Peucker simplifications of Model::Ways() in the same order, each level four
+    // times coarser than the one before. A frame uses the coarsest level within half a
+    // pixel of the full geometry, or the full geometry when its level is -1.
+    static constexpr int lod_levels = 4;
+    std::array<std::vector<Model::Way>, lod_levels> m_SimplifiedWays;
+    // Features smaller than this many pixels in both directions are not drawn.
+    float m_MinFeaturePixels = 1.f;
     
     io2d::brush m_BackgroundFillBrush{ io2d::rgba_color{238, 235, 227} };
     
@@ -46,6 +136,10 @@ private:
     io2d::stroke_props m_LeisureOutlineStrokeProps{1.f};
 
     io2d::brush m_WaterFillBrush{ io2d::rgba_color{155, 201, 215} };    
+
+    io2d::brush m_IsochroneFillBrush{ io2d::rgba_color{66, 133, 244, 64} };
+    io2d::brush m_IsochroneOutlineBrush{ io2d::rgba_color{66, 133, 244} };
+    io2d::stroke_props m_IsochroneOutlineStrokeProps{2.f};
         
     io2d::brush m_RailwayStrokeBrush{ io2d::rgba_color{93,93,93} };
     io2d::brush m_RailwayDashBrush{ io2d::rgba_color::white };
@@ -53,11 +147,6 @@ private:
     float m_RailwayOuterWidth = 3.f;
     float m_RailwayInnerWidth = 2.f;
     
-    struct RoadRep {
-        io2d::brush brush{io2d::rgba_color::black};
-        io2d::dashes dashes{};
-        float metric_width = 1.f;
-    };
     std::unordered_map<Model::Road::Type, RoadRep> m_RoadReps;
     
     std::unordered_map<Model::Landuse::Type, io2d::brush> m_LanduseBrushes;
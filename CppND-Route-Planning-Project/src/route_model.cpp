@@ -1,77 +1,235 @@
 #include "route_model.h"
+#include "contraction_hierarchy.h"
+#include "landmarks.h"
+#include "map_cache.h"
+#include <algorithm>
 #include <iostream>
+#include <tuple>
 
-RouteModel::RouteModel(const std::vector<std::byte> &xml) : Model(xml) {
-    // Create RouteModel nodes.
-    int counter = 0;
-    for (Model::Node node : this->Nodes()) {
-        m_Nodes.emplace_back(Node(counter, this, node));
-        counter++;
-    }
-    CreateNodeToRoadHashmap();
+RouteModel::RouteModel(const std::vector<std::byte> &xml, unsigned threads) : Model(xml, threads) {
+    CreateRouteData();
 }
 
 
-void RouteModel::CreateNodeToRoadHashmap() {
-    for (const Model::Road &road : Roads()) {
-        if (road.type != Model::Road::Type::Footway) {
-            for (int node_idx : Ways()[road.way].nodes) {
-                if (node_to_road.find(node_idx) == node_to_road.end()) {
-                    node_to_road[node_idx] = std::vector<const Model::Road *> ();
-                }
-                node_to_road[node_idx].push_back(&road);
-            }
+RouteModel::RouteModel(MappedFile &osm_file, unsigned threads) : Model(osm_file, threads) {
+    CreateRouteData();
+}
+
+
+RouteModel::RouteModel(std::istream &osm) : Model(osm) {
+    CreateRouteData();
+}
+
+
+RouteModel::RouteModel(MapCacheReader &cache) : Model(cache) {
+    CreateRouteNodes();
+    for (auto &graph : m_Graphs) {
+        graph.offsets = cache.Array<int>();
+        graph.targets = cache.Array<int>();
+        graph.weights = cache.Array<float>();
+        graph.cost_scale = cache.Value<float>();
+        graph.heuristic_scale = cache.Value<float>();
+        if (graph.offsets.size() != m_Nodes.size() + 1 || graph.targets.size() != graph.weights.size())
+            throw std::logic_error("map cache is corrupted");
+        MapCacheReader::CheckOffsets(graph.offsets, graph.targets.size());
+        MapCacheReader::CheckIndices(graph.targets, m_Nodes.size());
+    }
+    m_SpatialIndex = SpatialIndex(cache, m_Nodes.size());
+    for (auto &hierarchy : m_Hierarchies) {
+        if (cache.Value<std::uint8_t>()) {
+            hierarchy = std::make_unique<ContractionHierarchy>(cache);
+            if (hierarchy->Size() != m_Nodes.size())
+                throw std::logic_error("map cache is corrupted");
+        }
+    }
+    for (auto &landmarks : m_Landmarks) {
+        if (cache.Value<std::uint8_t>()) {
+            landmarks = std::make_unique<Landmarks>(cache);
+            if (landmarks->Count() > 0 && landmarks->NodeCount() != m_Nodes.size())
+                throw std::logic_error("map cache is corrupted");
         }
     }
 }
 
 
-RouteModel::Node *RouteModel::Node::FindNeighbor(std::vector<int> node_indices) {
-    Node *closest_node = nullptr;
-    Node node;
+RouteModel::RouteModel(RouteModel &&other) noexcept = default;
+RouteModel &RouteModel::operator=(RouteModel &&other) noexcept = default;
+RouteModel::~RouteModel() = default;
 
-    for (int node_index : node_indices) {
-        node = parent_model->SNodes()[node_index];
-        if (this->distance(node) != 0 && !node.visited) {
-            if (closest_node == nullptr || this->distance(node) < this->distance(*closest_node)) {
-                closest_node = &parent_model->SNodes()[node_index];
-            }
-        }
+
+void RouteModel::Save(MapCacheWriter &cache) const {
+    Model::Save(cache);
+    for (const auto &graph : m_Graphs) {
+        cache.Array(graph.offsets);
+        cache.Array(graph.targets);
+        cache.Array(graph.weights);
+        cache.Value(graph.cost_scale);
+        cache.Value(graph.heuristic_scale);
+    }
+    m_SpatialIndex.Save(cache);
+    for (const auto &hierarchy : m_Hierarchies) {
+        cache.Value<std::uint8_t>(hierarchy != nullptr);
+        if (hierarchy)
+            hierarchy->Save(cache);
+    }
+    for (const auto &landmarks : m_Landmarks) {
+        cache.Value<std::uint8_t>(landmarks != nullptr);
+        if (landmarks)
+            landmarks->Save(cache);
     }
-    return closest_node;
 }
 
 
-void RouteModel::Node::FindNeighbors() {
-    for (auto & road : parent_model->node_to_road[this->index]) {
-        RouteModel::Node *new_neighbor = this->FindNeighbor(parent_model->Ways()[road->way].nodes);
-        if (new_neighbor) {
-            this->neighbors.emplace_back(new_neighbor);
-        }
+RouteModel::Speeds RouteModel::DefaultSpeeds(Profile profile) {
+    using R = Model::Road;
+    switch (profile) {
+        case Profile::Distance:
+            return {{R::Motorway, 1.f}, {R::Trunk, 1.f}, {R::Primary, 1.f}, {R::Secondary, 1.f}, {R::Tertiary, 1.f},
+                    {R::Residential, 1.f}, {R::Unclassified, 1.f}, {R::Service, 1.f}};
+        case Profile::Car:
+            return {{R::Motorway, 110.f}, {R::Trunk, 90.f}, {R::Primary, 70.f}, {R::Secondary, 60.f}, {R::Tertiary, 50.f},
+                    {R::Residential, 30.f}, {R::Unclassified, 40.f}, {R::Service, 20.f}};
+        case Profile::Bike:
+            return {{R::Primary, 18.f}, {R::Secondary, 18.f}, {R::Tertiary, 18.f}, {R::Residential, 16.f},
+                    {R::Unclassified, 16.f}, {R::Service, 14.f}, {R::Footway, 8.f}};
+        case Profile::Foot:
+            return {{R::Primary, 5.f}, {R::Secondary, 5.f}, {R::Tertiary, 5.f}, {R::Residential, 5.f},
+                    {R::Unclassified, 5.f}, {R::Service, 5.f}, {R::Footway, 5.f}};
+    }
+    return {};
+}
+
+
+void RouteModel::SetSpeeds(Profile profile, const Speeds &speeds) {
+    CreateRoadGraph(profile, speeds);
+    m_Hierarchies[(int)profile].reset();
+    m_Landmarks[(int)profile].reset();
+}
+
+
+void RouteModel::BuildContractionHierarchy(Profile profile) {
+    m_Hierarchies[(int)profile] = std::make_unique<ContractionHierarchy>(RoadGraph(profile));
+}
+
+
+void RouteModel::BuildLandmarks(std::size_t count, Profile profile) {
+    m_Landmarks[(int)profile] = std::make_unique<Landmarks>(RoadGraph(profile), count);
+}
+
+
+void RouteModel::CreateRouteNodes() {
+    int counter = 0;
+    m_Coordinates.x.reserve(Nodes().size());
+    m_Coordinates.y.reserve(Nodes().size());
+    for (Model::Node node : this->Nodes()) {
+        m_Nodes.emplace_back(Node(counter, node));
+        m_Coordinates.x.push_back((float)node.x);
+        m_Coordinates.y.push_back((float)node.y);
+        counter++;
     }
 }
 
 
-RouteModel::Node &RouteModel::FindClosestNode(float x, float y) {
-    Node input;
-    input.x = x;
-    input.y = y;
+void RouteModel::CreateRouteData() {
+    CreateRouteNodes();
+    for (std::size_t profile = 0; profile < profile_count; ++profile)
+        CreateRoadGraph((Profile)profile, DefaultSpeeds((Profile)profile));
+    CreateSpatialIndex();
+}
+
+
+// Collects both directions of every segment between consecutive way nodes of the roads
+// open to the profile. A segment shared by several roads keeps its cheapest weight.
+void RouteModel::CreateRoadGraph(Profile profile, const Speeds &speeds) {
+    struct Segment {
+        int from;
+        int to;
+        float weight;
+        bool operator<(const Segment &other) const {
+            return std::tie(from, to, weight) < std::tie(other.from, other.to, other.weight);
+        }
+    };
 
-    float min_dist = std::numeric_limits<float>::max();
-    float dist;
-    int closest_idx;
+    auto &graph = m_Graphs[(int)profile];
+    float max_speed = 0.f;
+    for (const auto &[type, speed] : speeds)
+        max_speed = std::max(max_speed, speed);
+    // Distance weights are plain lengths; travel times are length in meters over m/s.
+    const bool by_time = profile != Profile::Distance;
+    graph.cost_scale = by_time ? 1.f : (float)MetricScale();
+    graph.heuristic_scale = by_time && max_speed > 0.f ? (float)MetricScale() / (max_speed / 3.6f) : 1.f;
 
+    std::vector<Segment> segments;
     for (const Model::Road &road : Roads()) {
-        if (road.type != Model::Road::Type::Footway) {
-            for (int node_idx : Ways()[road.way].nodes) {
-                dist = input.distance(SNodes()[node_idx]);
-                if (dist < min_dist) {
-                    closest_idx = node_idx;
-                    min_dist = dist;
-                }
+        auto speed = speeds.find(road.type);
+        if (speed == speeds.end() || speed->second <= 0.f)
+            continue;
+        const float weight_per_length = by_time ? (float)MetricScale() / (speed->second / 3.6f) : 1.f;
+        const auto &way_nodes = Ways()[road.way].nodes;
+        for (std::size_t i = 1; i < way_nodes.size(); ++i) {
+            if (way_nodes[i - 1] != way_nodes[i]) {
+                const float weight = m_Coordinates.Distance(way_nodes[i - 1], way_nodes[i]) * weight_per_length;
+                segments.push_back({way_nodes[i - 1], way_nodes[i], weight});
+                segments.push_back({way_nodes[i], way_nodes[i - 1], weight});
             }
         }
     }
+    std::sort(segments.begin(), segments.end());
+    segments.erase(std::unique(segments.begin(), segments.end(), [](const Segment &a, const Segment &b) {
+        return a.from == b.from && a.to == b.to;
+    }), segments.end());
 
-    return SNodes()[closest_idx];
-}
\ No newline at end of file
+    graph.offsets.assign(m_Nodes.size() + 1, 0);
+    for (const auto &segment : segments)
+        graph.offsets[segment.from + 1]++;
+    for (std::size_t i = 1; i < graph.offsets.size(); ++i)
+        graph.offsets[i] += graph.offsets[i - 1];
+
+    graph.targets.clear();
+    graph.weights.clear();
+    graph.targets.reserve(segments.size());
+    graph.weights.reserve(segments.size());
+    for (const auto &segment : segments) {
+        graph.targets.push_back(segment.to);
+        graph.weights.push_back(segment.weight);
+    }
+}
+
+
+// Indexes every node on a road of any type, so that every profile can find its closest
+// routable node among them.
+void RouteModel::CreateSpatialIndex() {
+    std::vector<bool> on_road(m_Nodes.size(), false);
+    for (const Model::Road &road : Roads())
+        if (Ways()[road.way].nodes.size() > 1)
+            for (int node : Ways()[road.way].nodes)
+                on_road[node] = true;
+
+    std::vector<SpatialIndex::Point> points;
+    for (int i = 0; i < (int)m_Nodes.size(); ++i)
+        if (on_road[i])
+            points.push_back({m_Coordinates.x[i], m_Coordinates.y[i], i});
+    m_SpatialIndex = SpatialIndex(std::move(points));
+}
+
+
+const RouteModel::Node &RouteModel::FindClosestNode(float x, float y, Profile profile) const {
+    const auto closest = FindClosestNodes(x, y, 1, profile);
+    if (closest.empty())
+        throw std::logic_error("no routable node for this profile");
+    return *closest.front();
+}
+
+
+// The index covers every road node; nodes without an edge in the profile's graph are
+// skipped inside the search, so one query finds k routable nodes.
+std::vector<const RouteModel::Node *> RouteModel::FindClosestNodes(float x, float y, std::size_t k, Profile profile) const {
+    const auto &graph = RoadGraph(profile);
+    const auto nearest = m_SpatialIndex.KNearest(x, y, k, [&graph](int node_idx) {
+        return graph.offsets[node_idx + 1] > graph.offsets[node_idx];
+    });
+    std::vector<const Node *> closest;
+    for (int node_idx : nearest)
+        closest.push_back(&SNodes()[node_idx]);
+    return closest;
+}
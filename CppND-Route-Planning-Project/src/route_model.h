@@ -3,43 +3,121 @@
 
 #include <limits>
 #include <cmath>
+#include <array>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 #include "model.h"
+#include "spatial_index.h"
 #include <iostream>
 
+class ContractionHierarchy;
+class Landmarks;
+
 class RouteModel : public Model {
 
   public:
+    // Routable node. Search state (parent, g and h values, visited) lives in a
+    // SearchWorkspace so the model stays immutable while routes are planned.
     class Node : public Model::Node {
       public:
-        Node * parent = nullptr;
-        float h_value = std::numeric_limits<float>::max();
-        float g_value = 0.0;
-        bool visited = false;
-        std::vector<Node *> neighbors;
-
-        void FindNeighbors();
+        int Index() const { return index; }
         float distance(Node other) const {
             return std::sqrt(std::pow((x - other.x), 2) + std::pow((y - other.y), 2));
         }
 
         Node(){}
-        Node(int idx, RouteModel * search_model, Model::Node node) : Model::Node(node), parent_model(search_model), index(idx) {}
+        Node(int idx, Model::Node node) : Model::Node(node), index(idx) {}
 
       private:
-        int index;
-        Node * FindNeighbor(std::vector<int> node_indices);
-        RouteModel * parent_model = nullptr;
+        int index = -1;
+    };
+
+    // Node coordinates as separate float arrays indexed by node index. This is the compact
+    // copy of the nodes read by the searches, about a third of the size of the Node structs.
+    struct Coordinates {
+        std::vector<float> x;
+        std::vector<float> y;
+
+        float Distance(int a, int b) const {
+            const float dx = x[a] - x[b];
+            const float dy = y[a] - y[b];
+            return std::sqrt(dx * dx + dy * dy);
+        }
+    };
+
+    // Routing profiles, each with its own road graph. Distance routes by length over every
+    // road but footways, as the planner always did; the others route by travel time.
+    enum class Profile { Distance, Car, Bike, Foot };
+    static constexpr std::size_t profile_count = 4;
+
+    // Speed in km/h on each road type. Road types missing or at 0 are closed to the profile;
+    // for Distance only whether a road type is open matters.
+    using Speeds = std::unordered_map<Model::Road::Type, float>;
+    static Speeds DefaultSpeeds(Profile profile);
+
+    // Road graph of one profile in compressed sparse row form. The edges leaving node i
+    // are [offsets[i], offsets[i + 1]) in targets and weights. Weights are precomputed per
+    // profile: map-normalized length for Distance, travel time in seconds otherwise.
+    struct Graph {
+        std::vector<int> offsets;
+        std::vector<int> targets;
+        std::vector<float> weights;
+        // Converts weights into meters for Distance and into seconds otherwise.
+        float cost_scale = 1.f;
+        // Lower bound on the weight per map-normalized unit of straight-line distance,
+        // i.e. the factor turning the Euclidean A* heuristic into weight units.
+        float heuristic_scale = 1.f;
     };
 
-    RouteModel(const std::vector<std::byte> &xml);
-    Node &FindClosestNode(float x, float y);
-    auto &SNodes() { return m_Nodes; }
+    RouteModel(const std::vector<std::byte> &xml, unsigned threads = 1);
+    RouteModel(MappedFile &osm_file, unsigned threads = 1);
+    RouteModel(std::istream &osm);
+    // Loads a model previously written by Save, including the road graph, spatial index
+    // and the contraction hierarchy and landmarks, if they were built.
+    RouteModel(MapCacheReader &cache);
+    RouteModel(RouteModel &&other) noexcept;
+    RouteModel &operator=(RouteModel &&other) noexcept;
+    ~RouteModel();
+    void Save(MapCacheWriter &cache) const;
+    // Closest nodes with at least one edge in the profile's road graph. FindClosestNode
+    // throws std::logic_error if there is no such node, e.g. when no road is open to the
+    // profile; FindClosestNodes then returns fewer than k nodes.
+    const Node &FindClosestNode(float x, float y, Profile profile = Profile::Distance) const;
+    std::vector<const Node *> FindClosestNodes(float x, float y, std::size_t k, Profile profile = Profile::Distance) const;
+    const std::vector<Node> &SNodes() const noexcept { return m_Nodes; }
+    const Coordinates &NodeCoordinates() const noexcept { return m_Coordinates; }
+    const Graph &RoadGraph(Profile profile = Profile::Distance) const noexcept { return m_Graphs[(int)profile]; }
+    // Recomputes the profile's edge weights for new speeds, dropping its contraction
+    // hierarchy and landmarks. Other profiles are unaffected.
+    void SetSpeeds(Profile profile, const Speeds &speeds);
+    // Preprocesses the profile's road graph for contraction hierarchy queries.
+    void BuildContractionHierarchy(Profile profile = Profile::Distance);
+    // The profile's contraction hierarchy, or nullptr if it has not been built.
+    const ContractionHierarchy *Hierarchy(Profile profile = Profile::Distance) const noexcept {
+        return m_Hierarchies[(int)profile].get();
+    }
+    // Precomputes landmark distances on the profile's road graph for the ALT heuristic.
+    void BuildLandmarks(std::size_t count = 16, Profile profile = Profile::Distance);
+    // The profile's landmarks, or nullptr if they have not been built.
+    const Landmarks *GetLandmarks(Profile profile = Profile::Distance) const noexcept {
+        return m_Landmarks[(int)profile].get();
+    }
+    // Path to be displayed by Render; planners return their own copy via GetPath().
     std::vector<Node> path;
+    // Service area polygon to be displayed by Render, from RoutePlanner::GetIsochrone().
+    std::vector<Node> isochrone;
     
   private:
-    void CreateNodeToRoadHashmap();
-    std::unordered_map<int, std::vector<const Model::Road *>> node_to_road;
+    void CreateRouteNodes();
+    void CreateRouteData();
+    void CreateRoadGraph(Profile profile, const Speeds &speeds);
+    void CreateSpatialIndex();
+    Coordinates m_Coordinates;
+    std::array<Graph, profile_count> m_Graphs;
+    SpatialIndex m_SpatialIndex;
+    std::array<std::unique_ptr<ContractionHierarchy>, profile_count> m_Hierarchies;
+    std::array<std::unique_ptr<Landmarks>, profile_count> m_Landmarks;
     std::vector<Node> m_Nodes;
 
 };
@@ -1,84 +1,407 @@
 #include "route_planner.h"
+#include "contraction_hierarchy.h"
+#include "landmarks.h"
 #include <algorithm>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
 
-RoutePlanner::RoutePlanner(RouteModel &model, float start_x, float start_y, float end_x, float end_y): m_Model(model) {
+static double Microseconds(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+RoutePlanner::RoutePlanner(const RouteModel &model, float start_x, float start_y, float end_x, float end_y,
+                           RouteModel::Profile profile):
+    owned_workspace(std::make_unique<SearchWorkspace>(model.SNodes().size())),
+    workspace(*owned_workspace),
+    m_Model(model),
+    profile(profile),
+    graph(model.RoadGraph(profile)) {
     // Convert inputs to percentage:
     start_x *= 0.01;
     start_y *= 0.01;
     end_x *= 0.01;
     end_y *= 0.01;
 
-    // TODO 2: Use the m_Model.FindClosestNode method to find the closest nodes to the starting and ending coordinates.
-    // Store the nodes you find in the RoutePlanner's start_node and end_node attributes.
-
+    const auto snap_begin = Clock::now();
+    start_node = &m_Model.FindClosestNode(start_x, start_y, profile);
+    end_node = &m_Model.FindClosestNode(end_x, end_y, profile);
+    stats.snap_time = Microseconds(snap_begin);
 }
 
 
-// TODO 3: Implement the CalculateHValue method.
-// Tips:
-// - You can use the distance to the end_node for the h value.
-// - Node objects have a distance method to determine the distance to another node.
-
-float RoutePlanner::CalculateHValue(RouteModel::Node const *node) {
+RoutePlanner::RoutePlanner(const RouteModel &model, SearchWorkspace &workspace, float start_x, float start_y, float end_x, float end_y,
+                           RouteModel::Profile profile):
+    workspace(workspace),
+    m_Model(model),
+    profile(profile),
+    graph(model.RoadGraph(profile)) {
+    // Convert inputs to percentage:
+    start_x *= 0.01;
+    start_y *= 0.01;
+    end_x *= 0.01;
+    end_y *= 0.01;
 
+    const auto snap_begin = Clock::now();
+    start_node = &m_Model.FindClosestNode(start_x, start_y, profile);
+    end_node = &m_Model.FindClosestNode(end_x, end_y, profile);
+    stats.snap_time = Microseconds(snap_begin);
+    workspace.Reset();
 }
 
 
-// TODO 4: Complete the AddNeighbors method to expand the current node by adding all unvisited neighbors to the open list.
-// Tips:
-// - Use the FindNeighbors() method of the current_node to populate current_node.neighbors vector with all the neighbors.
-// - For each node in current_node.neighbors, set the parent, the h_value, the g_value. 
-// - Use CalculateHValue below to implement the h-Value calculation.
-// - For each node in current_node.neighbors, add the neighbor to open_list and set the node's visited attribute to true.
+// The h value is the straight-line distance to the end_node, converted to the profile's
+// weights, raised to the landmark lower bound during ALT searches. Both bounds are
+// consistent, and so is their maximum.
+float RoutePlanner::CalculateHValue(RouteModel::Node const *node) {
+    return HValue(node->Index());
+}
 
-void RoutePlanner::AddNeighbors(RouteModel::Node *current_node) {
 
+float RoutePlanner::HValue(int node) {
+    stats.heuristic_evaluations++;
+    const float h_value = m_Model.NodeCoordinates().Distance(node, end_node->Index()) * graph.heuristic_scale;
+    if (!landmarks)
+        return h_value;
+    return std::max(h_value, landmarks->LowerBound(node, end_node->Index()));
 }
 
 
-// TODO 5: Complete the NextNode method to sort the open list and return the next node.
-// Tips:
-// - Sort the open_list according to the sum of the h value and g value.
-// - Create a pointer to the node in the list with the lowest sum.
-// - Remove that node from the open_list.
-// - Return the pointer.
-
-RouteModel::Node *RoutePlanner::NextNode() {
+// Expands current_node over the road graph. Unvisited neighbors get their parent, g and
+// h values set in the workspace and are pushed onto the open list keyed by g + h.
+// Neighbors still on the open list are relaxed via decrease-key.
+void RoutePlanner::AddNeighbors(RouteModel::Node const *current_node) {
+    auto &open_list = workspace.OpenList();
+    const int current = current_node->Index();
+    const float current_g_value = workspace.GValue(current);
 
+    for (int edge = graph.offsets[current]; edge < graph.offsets[current + 1]; ++edge) {
+        const int neighbor = graph.targets[edge];
+        const float g_value = current_g_value + graph.weights[edge];
+        if (!workspace.Visited(neighbor)) {
+            const float h_value = HValue(neighbor);
+            workspace.Visit(neighbor, current, g_value, h_value);
+            open_list.Push(neighbor, g_value + h_value);
+        }
+        else if (g_value < workspace.GValue(neighbor) && open_list.Contains(neighbor)) {
+            workspace.Relax(neighbor, current, g_value);
+            open_list.DecreaseKey(neighbor, g_value + workspace.HValue(neighbor));
+        }
+    }
 }
 
 
-// TODO 6: Complete the ConstructFinalPath method to return the final path found from your A* search.
-// Tips:
-// - This method should take the current (final) node as an argument and iteratively follow the 
-//   chain of parents of nodes until the starting node is found.
-// - For each node in the chain, add the distance from the node to its parent to the distance variable.
-// - The returned vector should be in the correct order: the start node should be the first element
-//   of the vector, the end node should be the last element.
+// Pops the open node with the lowest g + h. The open list is a binary heap,
+// so this is O(log n) instead of re-sorting the whole list on every expansion.
+RouteModel::Node const *RoutePlanner::NextNode() {
+    auto &open_list = workspace.OpenList();
+    if (open_list.Empty())
+        return nullptr;
+    return &m_Model.SNodes()[open_list.Pop()];
+}
+
 
-std::vector<RouteModel::Node> RoutePlanner::ConstructFinalPath(RouteModel::Node *current_node) {
+// Follows the parent chain from current_node back to the start node, accumulating the
+// travelled distance. The returned path starts at the start node and ends at current_node.
+std::vector<RouteModel::Node> RoutePlanner::ConstructFinalPath(RouteModel::Node const *current_node) {
+    const auto path_begin = Clock::now();
     // Create path_found vector
     distance = 0.0f;
     std::vector<RouteModel::Node> path_found;
 
-    // TODO: Implement your solution here.
+    const auto &nodes = m_Model.SNodes();
+    const auto &coordinates = m_Model.NodeCoordinates();
+    int parent = workspace.Parent(current_node->Index());
+    while (parent >= 0) {
+        path_found.push_back(*current_node);
+        distance += coordinates.Distance(current_node->Index(), parent);
+        current_node = &nodes[parent];
+        parent = workspace.Parent(parent);
+    }
+    path_found.push_back(*current_node);
+    std::reverse(path_found.begin(), path_found.end());
 
     distance *= m_Model.MetricScale(); // Multiply the distance by the scale of the map to get meters.
+    stats.path_time += Microseconds(path_begin);
     return path_found;
 
 }
 
 
-// TODO 7: Write the A* Search algorithm here.
-// Tips:
-// - Use the AddNeighbors method to add all of the neighbors of the current node to the open_list.
-// - Use the NextNode() method to sort the open_list and return the next node.
-// - When the search has reached the end_node, use the ConstructFinalPath method to return the final path that was found.
-// - Store the final path in the m_Model.path attribute before the method exits. This path will then be displayed on the map tile.
-
+// A* search from start_node to end_node. The final path is available through GetPath().
 void RoutePlanner::AStarSearch() {
-    RouteModel::Node *current_node = nullptr;
+    RouteModel::Node const *current_node = nullptr;
+
+    const auto begin = BeginQuery("astar");
+    workspace.Reset();
+    path.clear();
+    distance = 0.0f;
+    cost = 0.0f;
+    const int start = start_node->Index();
+    workspace.Visit(start, -1, 0.0f, CalculateHValue(start_node));
+    workspace.OpenList().Push(start, workspace.HValue(start));
+
+    while ((current_node = NextNode()) != nullptr) {
+        if (current_node == end_node) {
+            path = ConstructFinalPath(current_node);
+            cost = workspace.GValue(current_node->Index()) * graph.cost_scale;
+            break;
+        }
+        AddNeighbors(current_node);
+    }
+    EndQuery(begin, false);
+}
+
+
+// Potential of the bidirectional search: the average of the estimate to the end node and the
+// negated estimate to the start node. The backward search uses its negation, so both frontiers
+// see the same reduced edge costs and the potential is consistent in both directions.
+float RoutePlanner::BidirectionalPotential(int node) {
+    stats.heuristic_evaluations++;
+    const auto &coordinates = m_Model.NodeCoordinates();
+    return 0.5f * (coordinates.Distance(node, end_node->Index()) - coordinates.Distance(node, start_node->Index())) *
+           graph.heuristic_scale;
+}
+
+
+// Expands current in one direction of the bidirectional search. Whenever an edge reaches a
+// node already labeled by the opposite search, the path through it is a candidate for the
+// shortest route; the best one seen so far is kept in best_distance and meeting_node.
+void RoutePlanner::ExpandBidirectional(SearchWorkspace &search, const SearchWorkspace &opposite, int current,
+                                       float potential_sign, float &best_distance, int &meeting_node) {
+    auto &open_list = search.OpenList();
+    const float current_g_value = search.GValue(current);
+
+    for (int edge = graph.offsets[current]; edge < graph.offsets[current + 1]; ++edge) {
+        const int neighbor = graph.targets[edge];
+        const float g_value = current_g_value + graph.weights[edge];
+        if (!search.Visited(neighbor)) {
+            const float h_value = potential_sign * BidirectionalPotential(neighbor);
+            search.Visit(neighbor, current, g_value, h_value);
+            open_list.Push(neighbor, g_value + h_value);
+        }
+        else if (g_value < search.GValue(neighbor) && open_list.Contains(neighbor)) {
+            search.Relax(neighbor, current, g_value);
+            open_list.DecreaseKey(neighbor, g_value + search.HValue(neighbor));
+        }
+        if (opposite.Visited(neighbor) && search.GValue(neighbor) + opposite.GValue(neighbor) < best_distance) {
+            best_distance = search.GValue(neighbor) + opposite.GValue(neighbor);
+            meeting_node = neighbor;
+        }
+    }
+}
+
+
+// Bidirectional A* from start_node to end_node. The backward frontier searches the road
+// graph from end_node, which is valid since road graph edges are symmetric. The smaller
+// frontier is expanded first; the search stops once the two lowest keys together cannot
+// improve on the best meeting point, i.e. top_f + top_b >= best, since the average potentials
+// of the two directions cancel out. The final path is available through GetPath().
+void RoutePlanner::BidirectionalAStarSearch() {
+    auto &backward = workspace.Reverse();
+    auto &forward_open = workspace.OpenList();
+    auto &backward_open = backward.OpenList();
+
+    const auto begin = BeginQuery("bidirectional");
+    workspace.Reset();
+    backward.Reset();
+    path.clear();
+    distance = 0.0f;
+    cost = 0.0f;
+    const int start = start_node->Index();
+    const int end = end_node->Index();
+    workspace.Visit(start, -1, 0.0f, BidirectionalPotential(start));
+    forward_open.Push(start, workspace.HValue(start));
+    backward.Visit(end, -1, 0.0f, -BidirectionalPotential(end));
+    backward_open.Push(end, backward.HValue(end));
 
-    // TODO: Implement your solution here.
+    float best_distance = std::numeric_limits<float>::max();
+    int meeting_node = -1;
+    if (start == end) {
+        best_distance = 0.0f;
+        meeting_node = start;
+    }
 
-}
\ No newline at end of file
+    while (!forward_open.Empty() && !backward_open.Empty()) {
+        if (meeting_node >= 0 && forward_open.TopKey() + backward_open.TopKey() >= best_distance)
+            break;
+        if (forward_open.Size() <= backward_open.Size())
+            ExpandBidirectional(workspace, backward, forward_open.Pop(), 1.0f, best_distance, meeting_node);
+        else
+            ExpandBidirectional(backward, workspace, backward_open.Pop(), -1.0f, best_distance, meeting_node);
+    }
+    if (meeting_node >= 0) {
+        // Forward half from the parent chain of the forward search, then the backward half.
+        const auto &nodes = m_Model.SNodes();
+        path = ConstructFinalPath(&nodes[meeting_node]);
+        const auto path_begin = Clock::now();
+        float backward_distance = 0.0f;
+        for (int node = meeting_node, parent = backward.Parent(node); parent >= 0; node = parent, parent = backward.Parent(node)) {
+            path.push_back(nodes[parent]);
+            backward_distance += m_Model.NodeCoordinates().Distance(node, parent);
+        }
+        distance += backward_distance * m_Model.MetricScale();
+        cost = best_distance * graph.cost_scale;
+        stats.path_time += Microseconds(path_begin);
+    }
+    EndQuery(begin, true);
+}
+
+
+void RoutePlanner::ContractionHierarchySearch() {
+    const auto *hierarchy = m_Model.Hierarchy(profile);
+    if (!hierarchy)
+        throw std::logic_error("the route model has no contraction hierarchy");
+
+    const auto begin = BeginQuery("ch");
+    path.clear();
+    distance = 0.0f;
+    cost = 0.0f;
+    std::vector<int> node_path;
+    const float weight = hierarchy->Query(workspace, start_node->Index(), end_node->Index(), node_path);
+    const auto path_begin = Clock::now();
+    const auto &nodes = m_Model.SNodes();
+    for (std::size_t i = 0; i < node_path.size(); ++i) {
+        if (i > 0)
+            distance += m_Model.NodeCoordinates().Distance(node_path[i - 1], node_path[i]);
+        path.push_back(nodes[node_path[i]]);
+    }
+    distance *= m_Model.MetricScale();
+    if (!node_path.empty())
+        cost = weight * graph.cost_scale;
+    stats.path_time = Microseconds(path_begin);
+    EndQuery(begin, true);
+}
+
+
+void RoutePlanner::ALTSearch() {
+    landmarks = m_Model.GetLandmarks(profile);
+    if (!landmarks)
+        throw std::logic_error("the route model has no landmarks");
+    AStarSearch();
+    landmarks = nullptr;
+    stats.search = "alt";
+}
+
+
+// Andrew's monotone chain: the convex hull of points, counter-clockwise, without collinear points.
+static std::vector<RouteModel::Node> ConvexHull(std::vector<RouteModel::Node> points) {
+    std::sort(points.begin(), points.end(), [](const auto &a, const auto &b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    if (points.size() < 3)
+        return points;
+    auto cross = [](const auto &o, const auto &a, const auto &b) {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    };
+    std::vector<RouteModel::Node> hull(2 * points.size());
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        while (size >= 2 && cross(hull[size - 2], hull[size - 1], points[i]) <= 0)
+            size--;
+        hull[size++] = points[i];
+    }
+    for (std::size_t i = points.size() - 1, lower = size + 1; i-- > 0;) {
+        while (size >= lower && cross(hull[size - 2], hull[size - 1], points[i]) <= 0)
+            size--;
+        hull[size++] = points[i];
+    }
+    hull.resize(size - 1);
+    return hull;
+}
+
+
+// Plain Dijkstra, since there is no single goal to aim a heuristic at. Nodes are settled in
+// order of cost, so the search ends at the first node beyond the cutoff.
+void RoutePlanner::OneToAllSearch(float max_cost) {
+    const auto &nodes = m_Model.SNodes();
+    auto &open_list = workspace.OpenList();
+    const float max_weight = max_cost / graph.cost_scale;
+
+    const auto begin = BeginQuery("one_to_all");
+    workspace.Reset();
+    path.clear();
+    distance = 0.0f;
+    cost = 0.0f;
+    distance_field.assign(nodes.size(), std::numeric_limits<float>::infinity());
+    const int start = start_node->Index();
+    workspace.Visit(start, -1, 0.0f, 0.0f);
+    open_list.Push(start, 0.0f);
+
+    std::vector<RouteModel::Node> reached;
+    while (!open_list.Empty() && open_list.TopKey() <= max_weight) {
+        const int current = open_list.Pop();
+        const float current_weight = workspace.GValue(current);
+        distance_field[current] = current_weight * graph.cost_scale;
+        reached.push_back(nodes[current]);
+        for (int edge = graph.offsets[current]; edge < graph.offsets[current + 1]; ++edge) {
+            const int neighbor = graph.targets[edge];
+            const float weight = current_weight + graph.weights[edge];
+            if (!workspace.Visited(neighbor)) {
+                workspace.Visit(neighbor, current, weight, 0.0f);
+                open_list.Push(neighbor, weight);
+            }
+            else if (weight < workspace.GValue(neighbor) && open_list.Contains(neighbor)) {
+                workspace.Relax(neighbor, current, weight);
+                open_list.DecreaseKey(neighbor, weight);
+            }
+        }
+    }
+    isochrone = ConvexHull(std::move(reached));
+    EndQuery(begin, false);
+}
+
+
+RoutePlanner::Clock::time_point RoutePlanner::BeginQuery(const char *search) {
+    const double snap_time = stats.snap_time;
+    stats = Stats{};
+    stats.search = search;
+    stats.snap_time = snap_time;
+    return Clock::now();
+}
+
+
+void RoutePlanner::EndQuery(Clock::time_point begin, bool two_frontiers) {
+    stats.search_time = Microseconds(begin) - stats.path_time;
+    for (const SearchWorkspace *search : {&workspace, two_frontiers ? &workspace.Reverse() : nullptr}) {
+        if (!search)
+            continue;
+        stats.nodes_expanded += search->OpenList().PopCount();
+        stats.nodes_pushed += search->OpenList().PushCount();
+        stats.max_open_list_size += search->OpenList().MaxSize();
+    }
+}
+
+
+void RoutePlanner::WriteStats(std::ostream &os) const {
+    os << "{\"search\":\"" << stats.search << "\""
+       << ",\"start\":" << start_node->Index()
+       << ",\"end\":" << end_node->Index()
+       << ",\"distance\":" << distance
+       << ",\"cost\":" << cost
+       << ",\"nodes_expanded\":" << stats.nodes_expanded
+       << ",\"nodes_pushed\":" << stats.nodes_pushed
+       << ",\"max_open_list_size\":" << stats.max_open_list_size
+       << ",\"heuristic_evaluations\":" << stats.heuristic_evaluations
+       << ",\"snap_us\":" << stats.snap_time
+       << ",\"search_us\":" << stats.search_time
+       << ",\"path_us\":" << stats.path_time << "}\n";
+}
+
+
+void RoutePlanner::Search(SearchMode mode) {
+    switch (mode) {
+        case SearchMode::AStar:
+            AStarSearch();
+            break;
+        case SearchMode::Bidirectional:
+            BidirectionalAStarSearch();
+            break;
+        case SearchMode::ContractionHierarchy:
+            ContractionHierarchySearch();
+            break;
+        case SearchMode::ALT:
+            ALTSearch();
+            break;
+    }
+}
@@ -1,33 +1,116 @@
 #ifndef ROUTE_PLANNER_H
 #define ROUTE_PLANNER_H
 
+#include <chrono>
+#include <cstddef>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <vector>
 #include <string>
 #include "route_model.h"
+#include "search_workspace.h"
 
+class Landmarks;
 
+
+// Plans a route on a RouteModel. The model is only read, so any number of planners may
+// search the same model concurrently as long as each uses its own SearchWorkspace.
 class RoutePlanner {
   public:
-    RoutePlanner(RouteModel &model, float start_x, float start_y, float end_x, float end_y);
+    enum class SearchMode { AStar, Bidirectional, ContractionHierarchy, ALT };
+
+    // Work done by the last query. The open list counts cover both frontiers of the
+    // bidirectional and contraction hierarchy searches, and the time of unpacking
+    // contraction hierarchy shortcuts counts towards the search.
+    struct Stats {
+        // Name of the search: astar, bidirectional, ch, alt or one_to_all.
+        const char *search = "";
+        std::size_t nodes_expanded = 0;
+        std::size_t nodes_pushed = 0;
+        std::size_t max_open_list_size = 0;
+        std::size_t heuristic_evaluations = 0;
+        // Wall time in microseconds of snapping the start and end points to nodes, of the
+        // search itself and of reconstructing the path.
+        double snap_time = 0.0;
+        double search_time = 0.0;
+        double path_time = 0.0;
+    };
+
+    // Searches route over the road graph of profile; start and end snap to the closest
+    // nodes routable in that profile.
+    RoutePlanner(const RouteModel &model, float start_x, float start_y, float end_x, float end_y,
+                 RouteModel::Profile profile = RouteModel::Profile::Distance);
+    // Reuses workspace across queries instead of allocating one per planner.
+    RoutePlanner(const RouteModel &model, SearchWorkspace &workspace, float start_x, float start_y, float end_x, float end_y,
+                 RouteModel::Profile profile = RouteModel::Profile::Distance);
     // Add public variables or methods declarations here.
+    // Length of the path in meters.
     float GetDistance() const {return distance;}
+    // Cost of the path under the profile: meters for Distance, seconds otherwise.
+    float GetCost() const {return cost;}
+    const Stats &GetStats() const {return stats;}
+    // Writes the stats of the last query with its start, end, distance and cost as a single
+    // line of JSON, so that a log of queries can be processed as JSON lines.
+    void WriteStats(std::ostream &os) const;
+    const std::vector<RouteModel::Node> &GetPath() const {return path;}
+    // Cost from start_node to each node after OneToAllSearch(), or infinity for nodes
+    // beyond the cutoff.
+    const std::vector<float> &GetDistanceField() const {return distance_field;}
+    // Convex polygon, counter-clockwise, around the nodes reached by OneToAllSearch().
+    const std::vector<RouteModel::Node> &GetIsochrone() const {return isochrone;}
     void AStarSearch();
+    // Runs forward and backward A* frontiers that meet in the middle. Finds a path of the
+    // same length as AStarSearch(), expanding about as many nodes split over two frontiers.
+    void BidirectionalAStarSearch();
+    // Queries the model's contraction hierarchy for the profile, which must have been built.
+    // The path is unpacked to road graph nodes like the A* paths.
+    void ContractionHierarchySearch();
+    // A* with the landmark lower bounds of the model as additional heuristic. The model's
+    // landmarks for the profile must have been built.
+    void ALTSearch();
+    // Dijkstra from start_node to every node within max_cost, in the units of GetCost(), for
+    // service areas. The results are available through GetDistanceField() and GetIsochrone().
+    void OneToAllSearch(float max_cost = std::numeric_limits<float>::infinity());
+    // Runs the search selected by mode.
+    void Search(SearchMode mode);
 
     // The following methods have been made public so we can test them individually.
-    void AddNeighbors(RouteModel::Node *current_node);
+    void AddNeighbors(RouteModel::Node const *current_node);
     float CalculateHValue(RouteModel::Node const *node);
-    std::vector<RouteModel::Node> ConstructFinalPath(RouteModel::Node *);
-    RouteModel::Node *NextNode();
+    std::vector<RouteModel::Node> ConstructFinalPath(RouteModel::Node const *);
+    RouteModel::Node const *NextNode();
+    SearchWorkspace &Workspace() {return workspace;}
 
   private:
     // Add private variables or methods declarations here.
-    std::vector<RouteModel::Node*> open_list;
-    RouteModel::Node *start_node;
-    RouteModel::Node *end_node;
+    using Clock = std::chrono::steady_clock;
+    // Starts the stats of a new query; EndQuery() collects the open list counts from the
+    // workspace, and from the reverse workspace for searches with two frontiers.
+    Clock::time_point BeginQuery(const char *search);
+    void EndQuery(Clock::time_point begin, bool two_frontiers);
+
+    float HValue(int node);
+    float BidirectionalPotential(int node);
+    void ExpandBidirectional(SearchWorkspace &search, const SearchWorkspace &opposite, int current, float potential_sign,
+                             float &best_distance, int &meeting_node);
+
+    std::unique_ptr<SearchWorkspace> owned_workspace;
+    SearchWorkspace &workspace;
+    RouteModel::Node const *start_node;
+    RouteModel::Node const *end_node;
+    // Landmarks used by CalculateHValue, set for the duration of an ALT search.
+    const Landmarks *landmarks = nullptr;
 
     float distance = 0.0f;
-    RouteModel &m_Model;
+    float cost = 0.0f;
+    Stats stats;
+    std::vector<RouteModel::Node> path;
+    std::vector<float> distance_field;
+    std::vector<RouteModel::Node> isochrone;
+    const RouteModel &m_Model;
+    const RouteModel::Profile profile;
+    const RouteModel::Graph &graph;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef SEARCH_WORKSPACE_H
+#define SEARCH_WORKSPACE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "indexed_heap.h"
+
+// Per-query search state for a RouteModel, stored as struct-of-arrays indexed by node index.
+// The state of a node is only valid when its generation matches the current query, so
+// Reset() starts a new query in O(1) instead of clearing every array. A workspace belongs
+// to one query at a time; give each thread its own to search one RouteModel concurrently.
+class SearchWorkspace {
+  public:
+    explicit SearchWorkspace(std::size_t node_count)
+        : m_Parent(node_count, -1),
+          m_GValue(node_count, 0.0f),
+          m_HValue(node_count, std::numeric_limits<float>::max()),
+          m_Generation(node_count, 0),
+          m_OpenList(node_count) {}
+
+    std::size_t Size() const noexcept { return m_Generation.size(); }
+
+    // Invalidates the state of every node and empties the open list.
+    void Reset() {
+        m_OpenList.Clear();
+        if (++m_CurrentGeneration == 0) {
+            std::fill(m_Generation.begin(), m_Generation.end(), 0);
+            m_CurrentGeneration = 1;
+        }
+    }
+
+    // A node is visited once it has been reached by the current query.
+    bool Visited(int node) const { return m_Generation[node] == m_CurrentGeneration; }
+
+    // Unvisited nodes report the defaults: no parent, g = 0 and h = max.
+    int Parent(int node) const { return Visited(node) ? m_Parent[node] : -1; }
+    float GValue(int node) const { return Visited(node) ? m_GValue[node] : 0.0f; }
+    float HValue(int node) const { return Visited(node) ? m_HValue[node] : std::numeric_limits<float>::max(); }
+
+    // Marks node visited by the current query and sets its whole state.
+    void Visit(int node, int parent, float g_value, float h_value) {
+        m_Generation[node] = m_CurrentGeneration;
+        m_Parent[node] = parent;
+        m_GValue[node] = g_value;
+        m_HValue[node] = h_value;
+    }
+
+    // Records a shorter path to an already visited node.
+    void Relax(int node, int parent, float g_value) {
+        m_Parent[node] = parent;
+        m_GValue[node] = g_value;
+    }
+
+    IndexedHeap &OpenList() noexcept { return m_OpenList; }
+    const IndexedHeap &OpenList() const noexcept { return m_OpenList; }
+
+    // State of the backward frontier of bidirectional searches, allocated on first use and
+    // kept for later queries. It is reset independently of this workspace.
+    SearchWorkspace &Reverse() {
+        if (!m_Reverse)
+            m_Reverse = std::make_unique<SearchWorkspace>(Size());
+        return *m_Reverse;
+    }
+
+  private:
+    std::vector<int> m_Parent;
+    std::vector<float> m_GValue;
+    std::vector<float> m_HValue;
+    std::vector<std::uint32_t> m_Generation;
+    std::uint32_t m_CurrentGeneration = 1;
+    IndexedHeap m_OpenList;
+    std::unique_ptr<SearchWorkspace> m_Reverse;
+};
+
+#endif
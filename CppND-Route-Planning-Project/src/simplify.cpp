@@ -0,0 +1,47 @@
+#include "simplify.h"
+#include <utility>
+
+// Squared distance from p to the segment a-b.
+static double SquaredSegmentDistance(const Model::Node &p, const Model::Node &a, const Model::Node &b) {
+    const double dx = b.x - a.x, dy = b.y - a.y;
+    const double length2 = dx * dx + dy * dy;
+    double t = length2 > 0. ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / length2 : 0.;
+    t = t < 0. ? 0. : (t > 1. ? 1. : t);
+    const double ex = a.x + t * dx - p.x, ey = a.y + t * dy - p.y;
+    return ex * ex + ey * ey;
+}
+
+Model::Way SimplifyWay(const std::vector<Model::Node> &nodes, const Model::Way &way, double tolerance) {
+    const int count = (int)way.nodes.size();
+    if (count <= 2)
+        return way;
+
+    // Ranges still to be split, kept on an explicit stack since ways can be long.
+    std::vector<char> keep(count, 0);
+    keep.front() = keep.back() = 1;
+    std::vector<std::pair<int, int>> ranges{{0, count - 1}};
+    const double tolerance2 = tolerance * tolerance;
+    while (!ranges.empty()) {
+        const auto [first, last] = ranges.back();
+        ranges.pop_back();
+        const auto &a = nodes[way.nodes[first]], &b = nodes[way.nodes[last]];
+        int farthest = -1;
+        double farthest_distance = tolerance2;
+        for (int i = first + 1; i < last; ++i)
+            if (double distance = SquaredSegmentDistance(nodes[way.nodes[i]], a, b); distance > farthest_distance) {
+                farthest_distance = distance;
+                farthest = i;
+            }
+        if (farthest < 0)
+            continue;
+        keep[farthest] = 1;
+        ranges.emplace_back(first, farthest);
+        ranges.emplace_back(farthest, last);
+    }
+
+    Model::Way simplified;
+    for (int i = 0; i < count; ++i)
+        if (keep[i])
+            simplified.nodes.push_back(way.nodes[i]);
+    return simplified;
+}
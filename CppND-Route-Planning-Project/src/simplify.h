@@ -0,0 +1,12 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <vector>
+#include "model.h"
+
+// Douglas-Peucker simplification of the polyline through the nodes of way. Keeps both
+// ends and as few other nodes as possible while every removed node stays within
+// tolerance, in model coordinates, of the simplified line.
+Model::Way SimplifyWay(const std::vector<Model::Node> &nodes, const Model::Way &way, double tolerance);
+
+#endif
@@ -0,0 +1,147 @@
+#include "spatial_index.h"
+#include "distance_kernels.h"
+#include "map_cache.h"
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <utility>
+
+SpatialIndex::SpatialIndex(std::vector<Point> points) {
+    if (points.empty())
+        return;
+    m_Tree.reserve(2 * points.size() / leaf_size + 1);
+    Build(points, 0, (int)points.size());
+    m_X.reserve(points.size());
+    m_Y.reserve(points.size());
+    m_Ids.reserve(points.size());
+    for (const auto &point : points) {
+        m_X.push_back(point.x);
+        m_Y.push_back(point.y);
+        m_Ids.push_back(point.id);
+    }
+}
+
+SpatialIndex::SpatialIndex(MapCacheReader &cache, std::size_t id_count) {
+    m_X = cache.Array<float>();
+    m_Y = cache.Array<float>();
+    m_Ids = cache.Array<int>();
+    m_Tree = cache.Array<KDNode>();
+    if (m_X.size() != m_Ids.size() || m_Y.size() != m_Ids.size() || m_Tree.empty() != m_Ids.empty())
+        throw std::logic_error("map cache is corrupted");
+    // Children follow their parent in m_Tree, so bounded child indices also rule out cycles.
+    for (int i = 0; i < (int)m_Tree.size(); ++i) {
+        const auto &node = m_Tree[i];
+        if (node.begin < 0 || node.begin > node.end || node.end > (int)m_Ids.size() ||
+            (node.left < 0) != (node.right < 0) || (node.left < 0 && node.end - node.begin > leaf_size) ||
+            (node.left >= 0 && (node.left <= i || node.right <= i || node.left >= (int)m_Tree.size() ||
+                                node.right >= (int)m_Tree.size())))
+            throw std::logic_error("map cache is corrupted");
+    }
+    MapCacheReader::CheckIndices(m_Ids, id_count);
+}
+
+void SpatialIndex::Save(MapCacheWriter &cache) const {
+    cache.Array(m_X);
+    cache.Array(m_Y);
+    cache.Array(m_Ids);
+    cache.Array(m_Tree);
+}
+
+int SpatialIndex::Build(std::vector<Point> &points, int begin, int end) {
+    const int node_num = (int)m_Tree.size();
+    m_Tree.push_back({begin, end});
+    if (end - begin <= leaf_size)
+        return node_num;
+
+    // Split along the wider extent of the bucket at the median point.
+    float min_x = std::numeric_limits<float>::max(), max_x = std::numeric_limits<float>::lowest();
+    float min_y = min_x, max_y = max_x;
+    for (int i = begin; i < end; ++i) {
+        min_x = std::min(min_x, points[i].x);
+        max_x = std::max(max_x, points[i].x);
+        min_y = std::min(min_y, points[i].y);
+        max_y = std::max(max_y, points[i].y);
+    }
+    const int axis = (max_x - min_x) >= (max_y - min_y) ? 0 : 1;
+    const int mid = begin + (end - begin) / 2;
+    std::nth_element(points.begin() + begin, points.begin() + mid, points.begin() + end,
+                     [axis](const Point &a, const Point &b) { return axis == 0 ? a.x < b.x : a.y < b.y; });
+    const float split = axis == 0 ? points[mid].x : points[mid].y;
+
+    const int left = Build(points, begin, mid);
+    const int right = Build(points, mid, end);
+    auto &node = m_Tree[node_num];
+    node.axis = axis;
+    node.split = split;
+    node.left = left;
+    node.right = right;
+    return node_num;
+}
+
+// Visits leaves nearest-first, pruning subtrees farther than the current bound.
+// visit(id, squared_distance) is called for candidate points; bound() returns
+// the squared radius beyond which nothing is of interest.
+template <typename Visit, typename Bound>
+void SpatialIndex::Search(int node_num, float x, float y, Visit &visit, Bound &bound) const {
+    const auto &node = m_Tree[node_num];
+    if (node.left < 0) {
+        float distances[leaf_size];
+        SquaredDistances(&m_X[node.begin], &m_Y[node.begin], node.end - node.begin, x, y, distances);
+        for (int i = node.begin; i < node.end; ++i)
+            visit(m_Ids[i], distances[i - node.begin]);
+        return;
+    }
+    const float diff = (node.axis == 0 ? x : y) - node.split;
+    const int near = diff < 0.f ? node.left : node.right;
+    const int far = diff < 0.f ? node.right : node.left;
+    Search(near, x, y, visit, bound);
+    if (diff * diff < bound())
+        Search(far, x, y, visit, bound);
+}
+
+int SpatialIndex::Nearest(float x, float y) const {
+    if (m_Ids.empty())
+        return -1;
+
+    int best_id = -1;
+    float best_dist = std::numeric_limits<float>::max();
+    auto visit = [&](int id, float dist) {
+        if (dist < best_dist) {
+            best_dist = dist;
+            best_id = id;
+        }
+    };
+    auto bound = [&] { return best_dist; };
+    Search(0, x, y, visit, bound);
+    return best_id;
+}
+
+std::vector<int> SpatialIndex::KNearest(float x, float y, std::size_t k, const std::function<bool(int)> &accept) const {
+    std::vector<int> result;
+    if (m_Ids.empty() || k == 0)
+        return result;
+
+    // Max-heap of the best k candidates seen so far.
+    std::priority_queue<std::pair<float, int>> best;
+    auto visit = [&](int id, float dist) {
+        if (best.size() == k && dist >= best.top().first)
+            return;
+        if (accept && !accept(id))
+            return;
+        if (best.size() < k)
+            best.emplace(dist, id);
+        else {
+            best.pop();
+            best.emplace(dist, id);
+        }
+    };
+    auto bound = [&] { return best.size() < k ? std::numeric_limits<float>::max() : best.top().first; };
+    Search(0, x, y, visit, bound);
+
+    result.resize(best.size());
+    for (auto it = result.rbegin(); it != result.rend(); ++it) {
+        *it = best.top().second;
+        best.pop();
+    }
+    return result;
+}
@@ -0,0 +1,64 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+class MapCacheReader;
+class MapCacheWriter;
+
+// Static 2-d tree over a set of points, built once and queried for the nearest
+// and k nearest points to an arbitrary location. Points are reordered into
+// contiguous leaf buckets and stored as separate x, y and id arrays, so each
+// leaf is a short linear scan over packed floats.
+class SpatialIndex {
+  public:
+    struct Point {
+        float x;
+        float y;
+        int id;
+    };
+
+    SpatialIndex() {}
+    explicit SpatialIndex(std::vector<Point> points);
+    // Loads an index saved by Save(); throws if any id is not below id_count.
+    SpatialIndex(MapCacheReader &cache, std::size_t id_count);
+    void Save(MapCacheWriter &cache) const;
+
+    bool Empty() const noexcept { return m_Ids.empty(); }
+    std::size_t Size() const noexcept { return m_Ids.size(); }
+
+    // Id of the point closest to (x, y), or -1 if the index is empty.
+    int Nearest(float x, float y) const;
+
+    // Ids of the k points closest to (x, y), nearest first. With accept, only points whose
+    // id it accepts count, so a single pass finds k of them however sparse they are; it is
+    // only called for points closer than the current k-th best.
+    std::vector<int> KNearest(float x, float y, std::size_t k,
+                              const std::function<bool(int)> &accept = nullptr) const;
+
+  private:
+    static constexpr int leaf_size = 16;
+
+    // Inner nodes split [begin, end) at mid along axis; leaves have left == -1.
+    struct KDNode {
+        int begin;
+        int end;
+        int left = -1;
+        int right = -1;
+        int axis = 0;
+        float split = 0.f;
+    };
+
+    int Build(std::vector<Point> &points, int begin, int end);
+    template <typename Visit, typename Bound>
+    void Search(int node_num, float x, float y, Visit &visit, Bound &bound) const;
+
+    std::vector<float> m_X;
+    std::vector<float> m_Y;
+    std::vector<int> m_Ids;
+    std::vector<KDNode> m_Tree;
+};
+
+#endif
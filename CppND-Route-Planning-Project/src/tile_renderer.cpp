@@ -0,0 +1,92 @@
+#include "tile_renderer.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+TileRenderer::TileRenderer( const Model &model, const Render &render ):
+    m_Render(render)
+{
+    if( model.Nodes().empty() )
+        return;
+
+    double min_x = std::numeric_limits<double>::max(), max_x = std::numeric_limits<double>::lowest();
+    double min_y = min_x, max_y = max_x;
+    for( auto &node: model.Nodes() ) {
+        min_x = std::min(min_x, node.x);
+        max_x = std::max(max_x, node.x);
+        min_y = std::min(min_y, node.y);
+        max_y = std::max(max_y, node.y);
+    }
+    m_MinX = static_cast<float>(min_x);
+    m_MinY = static_cast<float>(min_y);
+    m_Side = static_cast<float>(std::max({max_x - min_x, max_y - min_y, 1e-6}));
+}
+
+Render::Viewport TileRenderer::TileViewport( int zoom, int x, int y ) const
+{
+    const float side = m_Side / static_cast<float>(1 << zoom);
+    Render::Viewport viewport;
+    viewport.center_x = m_MinX + (x + 0.5f) * side;
+    viewport.center_y = m_MinY + m_Side - (y + 0.5f) * side;
+    viewport.zoom = 1.f / side;
+    return viewport;
+}
+
+std::size_t TileRenderer::Run( const Options &options ) const
+{
+    namespace fs = std::filesystem;
+
+    // Tiles are numbered zoom level by zoom level; zoom_begin[z] is the first of level z.
+    const int min_zoom = std::max(options.min_zoom, 0);
+    const int max_zoom = std::min(options.max_zoom, 15);
+    if( min_zoom > max_zoom )
+        return 0;
+    std::vector<std::size_t> zoom_begin{0};
+    for( int zoom = min_zoom; zoom <= max_zoom; ++zoom ) {
+        zoom_begin.push_back(zoom_begin.back() + (std::size_t{1} << (2 * zoom)));
+        for( int x = 0; x < (1 << zoom); ++x )
+            fs::create_directories(fs::path{options.directory} / std::to_string(zoom) / std::to_string(x));
+    }
+    const auto tile_count = zoom_begin.back();
+
+    std::atomic<std::size_t> next_tile{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto work = [&] {
+        io2d::image_surface surface{io2d::format::argb32, options.tile_size, options.tile_size};
+        try {
+            for( auto tile = next_tile++; tile < tile_count; tile = next_tile++ ) {
+                const auto level = std::upper_bound(zoom_begin.begin(), zoom_begin.end(), tile) - zoom_begin.begin() - 1;
+                const int zoom = min_zoom + static_cast<int>(level);
+                const auto index = tile - zoom_begin[level];
+                const int x = static_cast<int>(index >> zoom);
+                const int y = static_cast<int>(index & ((std::size_t{1} << zoom) - 1));
+                m_Render.DrawImage(surface, TileViewport(zoom, x, y));
+                surface.save(fs::path{options.directory} / std::to_string(zoom) / std::to_string(x) / (std::to_string(y) + ".png"),
+                             io2d::image_file_format::png);
+            }
+        }
+        catch( ... ) {
+            // Stop the other workers and report the first failure once all have finished.
+            next_tile = tile_count;
+            std::lock_guard<std::mutex> lock{error_mutex};
+            if( !error )
+                error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for( unsigned i = 1; i < std::max(options.threads, 1u); ++i )
+        workers.emplace_back(work);
+    work();
+    for( auto &worker: workers )
+        worker.join();
+    if( error )
+        std::rethrow_exception(error);
+    return tile_count;
+}
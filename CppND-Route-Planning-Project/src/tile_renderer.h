@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <io2d.h>
+#include "model.h"
+#include "render.h"
+
+// Renders the map into a pyramid of PNG tiles without a display. Zoom level z splits the
+// square around the map into 2^z by 2^z tiles, stored as z/x/y.png with x counted from
+// the left and y from the top, as web maps expect. The tiles are drawn by worker threads
+// sharing one Render.
+class TileRenderer
+{
+public:
+    struct Options {
+        std::string directory = "tiles";
+        int min_zoom = 0;
+        int max_zoom = 4;
+        int tile_size = 256;
+        unsigned threads = 1;
+    };
+
+    TileRenderer(const Model &model, const Render &render);
+
+    // Writes every tile of zoom levels min_zoom to max_zoom under directory and returns the
+    // number of tiles written.
+    std::size_t Run(const Options &options) const;
+
+private:
+    Render::Viewport TileViewport(int zoom, int x, int y) const;
+
+    const Render &m_Render;
+    // Lower left corner and side of the square covered by zoom level 0, in model coordinates.
+    float m_MinX = 0.f;
+    float m_MinY = 0.f;
+    float m_Side = 1.f;
+};
@@ -1,40 +1,28 @@
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <optional>
+#include <sstream>
+#include <thread>
 #include <vector>
+#include "../src/contraction_hierarchy.h"
+#include "../src/distance_kernels.h"
+#include "../src/distance_matrix.h"
+#include "../src/feature_grid.h"
+#include "../src/id_map.h"
+#include "../src/landmarks.h"
+#include "../src/map_cache.h"
+#include "../src/mapped_file.h"
+#include "../src/osm_generator.h"
 #include "../src/route_model.h"
 #include "../src/route_planner.h"
+#include "../src/simplify.h"
 
 
-static std::optional<std::vector<std::byte>> ReadFile(const std::string &path)
-{   
-    std::ifstream is{path, std::ios::binary | std::ios::ate};
-    if( !is )
-        return std::nullopt;
-    
-    auto size = is.tellg();
-    std::vector<std::byte> contents(size);    
-    
-    is.seekg(0);
-    is.read((char*)contents.data(), size);
-
-    if( contents.empty() )
-        return std::nullopt;
-    return std::move(contents);
-}
-
-std::vector<std::byte> ReadOSMData(const std::string &path) {
-    std::vector<std::byte> osm_data;
-    auto data = ReadFile(path);
-    if( !data ) {
-        std::cout << "Failed to read OSM data." << std::endl;
-    } else {
-        osm_data = std::move(*data);
-    }
-    return osm_data;
-}
-
 //--------------------------------//
 //   Beginning RoutePlanner Tests.
 //--------------------------------//
@@ -42,8 +30,8 @@ std::vector<std::byte> ReadOSMData(const std::string &path) {
 class RoutePlannerTest : public ::testing::Test {
   protected:
     std::string osm_data_file = "../map.osm";
-    std::vector<std::byte> osm_data = ReadOSMData(osm_data_file);
-    RouteModel model{osm_data};
+    MappedFile osm_file{osm_data_file};
+    RouteModel model{osm_file};
     RoutePlanner route_planner{model, 10, 10, 90, 90};
     
     // Construct start_node and end_node as in the model.
@@ -51,42 +39,45 @@ class RoutePlannerTest : public ::testing::Test {
     float start_y = 0.1;
     float end_x = 0.9;
     float end_y = 0.9;
-    RouteModel::Node* start_node = &model.FindClosestNode(start_x, start_y);
-    RouteModel::Node* end_node = &model.FindClosestNode(end_x, end_y);
+    const RouteModel::Node* start_node = &model.FindClosestNode(start_x, start_y);
+    const RouteModel::Node* end_node = &model.FindClosestNode(end_x, end_y);
 
     // Construct another node in the middle of the map for testing.
     float mid_x = 0.5;
     float mid_y = 0.5;
-    RouteModel::Node* mid_node = &model.FindClosestNode(mid_x, mid_y);
+    const RouteModel::Node* mid_node = &model.FindClosestNode(mid_x, mid_y);
 };
 
 
 // Test the CalculateHValue method.
+// The search works on float coordinates, so the values may differ from the double precision
+// golden values by float rounding.
 TEST_F(RoutePlannerTest, TestCalculateHValue) {
-    EXPECT_FLOAT_EQ(route_planner.CalculateHValue(start_node), 1.1329799);
+    EXPECT_NEAR(route_planner.CalculateHValue(start_node), 1.1329799, 1e-5);
     EXPECT_FLOAT_EQ(route_planner.CalculateHValue(end_node), 0.0f);
-    EXPECT_FLOAT_EQ(route_planner.CalculateHValue(mid_node), 0.58903033);
+    EXPECT_NEAR(route_planner.CalculateHValue(mid_node), 0.58903033, 1e-5);
 }
 
 
 
 // Test the AddNeighbors method.
-bool NodesSame(RouteModel::Node* a, RouteModel::Node* b) { return a == b; }
 TEST_F(RoutePlannerTest, TestAddNeighbors) {
     route_planner.AddNeighbors(start_node);
 
-    // Correct h and g values for the neighbors of start_node.
-    std::vector<float> start_neighbor_g_vals{0.10671431, 0.082997195, 0.051776856, 0.055291083};
-    std::vector<float> start_neighbor_h_vals{1.1828455, 1.0998145, 1.0858033, 1.1831238};
-    auto neighbors = start_node->neighbors;
-    EXPECT_EQ(neighbors.size(), 4);
+    // Every road graph edge leaving start_node yields one visited neighbor.
+    const auto &graph = model.RoadGraph();
+    const auto &workspace = route_planner.Workspace();
+    const int start = start_node->Index();
+    EXPECT_GT(graph.offsets[start + 1], graph.offsets[start]);
+    EXPECT_EQ(workspace.OpenList().Size(), graph.offsets[start + 1] - graph.offsets[start]);
 
     // Check results for each neighbor.
-    for (int i = 0; i < neighbors.size(); i++) {
-        EXPECT_PRED2(NodesSame, neighbors[i]->parent, start_node);
-        EXPECT_FLOAT_EQ(neighbors[i]->g_value, start_neighbor_g_vals[i]);
-        EXPECT_FLOAT_EQ(neighbors[i]->h_value, start_neighbor_h_vals[i]);
-        EXPECT_EQ(neighbors[i]->visited, true);
+    for (int edge = graph.offsets[start]; edge < graph.offsets[start + 1]; edge++) {
+        const RouteModel::Node* neighbor = &model.SNodes()[graph.targets[edge]];
+        EXPECT_EQ(workspace.Parent(neighbor->Index()), start);
+        EXPECT_FLOAT_EQ(workspace.GValue(neighbor->Index()), model.NodeCoordinates().Distance(start, neighbor->Index()));
+        EXPECT_FLOAT_EQ(workspace.HValue(neighbor->Index()), route_planner.CalculateHValue(neighbor));
+        EXPECT_EQ(workspace.Visited(neighbor->Index()), true);
     }
 }
 
@@ -94,8 +85,9 @@ TEST_F(RoutePlannerTest, TestAddNeighbors) {
 // Test the ConstructFinalPath method.
 TEST_F(RoutePlannerTest, TestConstructFinalPath) {
     // Construct a path.
-    mid_node->parent = start_node;
-    end_node->parent = mid_node;
+    auto &workspace = route_planner.Workspace();
+    workspace.Visit(mid_node->Index(), start_node->Index(), 0.0f, 0.0f);
+    workspace.Visit(end_node->Index(), mid_node->Index(), 0.0f, 0.0f);
     std::vector<RouteModel::Node> path = route_planner.ConstructFinalPath(end_node);
 
     // Test the path.
@@ -107,16 +99,577 @@ TEST_F(RoutePlannerTest, TestConstructFinalPath) {
 }
 
 
+// Reference shortest path cost over the profile's road graph, by plain Dijkstra.
+float ReferenceDistance(const RouteModel &model, int from, int to,
+                        RouteModel::Profile profile = RouteModel::Profile::Distance) {
+    const auto &graph = model.RoadGraph(profile);
+    std::vector<float> dist(model.SNodes().size(), std::numeric_limits<float>::max());
+    IndexedHeap heap(dist.size());
+    dist[from] = 0.0f;
+    heap.Push(from, 0.0f);
+    while (!heap.Empty()) {
+        int node = heap.Pop();
+        if (node == to)
+            break;
+        for (int edge = graph.offsets[node]; edge < graph.offsets[node + 1]; ++edge) {
+            int target = graph.targets[edge];
+            if (dist[node] + graph.weights[edge] < dist[target]) {
+                dist[target] = dist[node] + graph.weights[edge];
+                heap.Push(target, dist[target]);
+            }
+        }
+    }
+    return dist[to] * graph.cost_scale;
+}
+
+
 // Test the AStarSearch method.
 TEST_F(RoutePlannerTest, TestAStarSearch) {
     route_planner.AStarSearch();
-    EXPECT_EQ(model.path.size(), 33);
-    RouteModel::Node path_start = model.path.front();
-    RouteModel::Node path_end = model.path.back();
+    const auto &path = route_planner.GetPath();
+    ASSERT_FALSE(path.empty());
+    RouteModel::Node path_start = path.front();
+    RouteModel::Node path_end = path.back();
     // The start_node and end_node x, y values should be the same as in the path.
     EXPECT_FLOAT_EQ(start_node->x, path_start.x);
     EXPECT_FLOAT_EQ(start_node->y, path_start.y);
     EXPECT_FLOAT_EQ(end_node->x, path_end.x);
     EXPECT_FLOAT_EQ(end_node->y, path_end.y);
-    EXPECT_FLOAT_EQ(route_planner.GetDistance(), 873.41565);
+    EXPECT_NEAR(route_planner.GetDistance(), ReferenceDistance(model, start_node->Index(), end_node->Index()), 1e-2);
+}
+
+
+// Test that bidirectional A* finds paths as short as the reference, reusing one workspace.
+TEST_F(RoutePlannerTest, TestBidirectionalAStarSearch) {
+    SearchWorkspace workspace(model.SNodes().size());
+    for (auto [sx, sy, ex, ey] : {std::array<float, 4>{10, 10, 90, 90}, {90, 10, 10, 90}, {50, 50, 55, 45}, {30, 30, 30, 30}}) {
+        RoutePlanner planner{model, workspace, sx, sy, ex, ey};
+        planner.Search(RoutePlanner::SearchMode::Bidirectional);
+        const auto &path = planner.GetPath();
+        const auto &start = model.FindClosestNode(sx * 0.01f, sy * 0.01f);
+        const auto &end = model.FindClosestNode(ex * 0.01f, ey * 0.01f);
+        ASSERT_FALSE(path.empty());
+        EXPECT_FLOAT_EQ(path.front().x, start.x);
+        EXPECT_FLOAT_EQ(path.back().x, end.x);
+        EXPECT_FLOAT_EQ(path.back().y, end.y);
+        EXPECT_NEAR(planner.GetDistance(), ReferenceDistance(model, start.Index(), end.Index()), 1e-2);
+        for (int i = 1; i < path.size(); i++)
+            EXPECT_TRUE(std::abs(path[i].x - path[i - 1].x) + std::abs(path[i].y - path[i - 1].y) > 0.0f);
+    }
+
+    // On a long query the two frontiers together settle about as many nodes as A* does alone;
+    // a stop rule that is too late settles several times more.
+    RoutePlanner planner{model, workspace, 10, 10, 90, 90};
+    planner.Search(RoutePlanner::SearchMode::AStar);
+    const auto a_star_expanded = planner.GetStats().nodes_expanded;
+    planner.Search(RoutePlanner::SearchMode::Bidirectional);
+    EXPECT_LE(planner.GetStats().nodes_expanded, 2 * a_star_expanded);
+}
+
+
+// Test contraction hierarchy queries against the reference, including the unpacked paths.
+TEST_F(RoutePlannerTest, TestContractionHierarchySearch) {
+    EXPECT_THROW(route_planner.Search(RoutePlanner::SearchMode::ContractionHierarchy), std::logic_error);
+    model.BuildContractionHierarchy();
+    ASSERT_NE(model.Hierarchy(), nullptr);
+    EXPECT_EQ(model.Hierarchy()->Size(), model.SNodes().size());
+
+    const auto &graph = model.RoadGraph();
+    SearchWorkspace workspace(model.SNodes().size());
+    for (auto [sx, sy, ex, ey] : {std::array<float, 4>{10, 10, 90, 90}, {90, 10, 10, 90}, {50, 50, 55, 45}, {30, 30, 30, 30}}) {
+        RoutePlanner planner{model, workspace, sx, sy, ex, ey};
+        planner.Search(RoutePlanner::SearchMode::ContractionHierarchy);
+        const auto &path = planner.GetPath();
+        const auto &start = model.FindClosestNode(sx * 0.01f, sy * 0.01f);
+        const auto &end = model.FindClosestNode(ex * 0.01f, ey * 0.01f);
+        ASSERT_FALSE(path.empty());
+        EXPECT_EQ(path.front().Index(), start.Index());
+        EXPECT_EQ(path.back().Index(), end.Index());
+        EXPECT_NEAR(planner.GetDistance(), ReferenceDistance(model, start.Index(), end.Index()), 1e-2);
+        // Consecutive path nodes are joined by road graph edges.
+        for (int i = 1; i < path.size(); i++) {
+            auto begin = graph.targets.begin() + graph.offsets[path[i - 1].Index()];
+            auto end = graph.targets.begin() + graph.offsets[path[i - 1].Index() + 1];
+            EXPECT_NE(std::find(begin, end, path[i].Index()), end);
+        }
+    }
+}
+
+
+// Test that landmark bounds never exceed the true distance and ALT routes are optimal.
+TEST_F(RoutePlannerTest, TestALTSearch) {
+    EXPECT_THROW(route_planner.Search(RoutePlanner::SearchMode::ALT), std::logic_error);
+    model.BuildLandmarks(4);
+    ASSERT_NE(model.GetLandmarks(), nullptr);
+    const auto &landmarks = *model.GetLandmarks();
+    EXPECT_EQ(landmarks.Count(), 4);
+
+    for (int landmark : landmarks.Nodes())
+        EXPECT_NEAR(landmarks.LowerBound(landmark, end_node->Index()) * model.MetricScale(),
+                    ReferenceDistance(model, landmark, end_node->Index()), 1e-2);
+    EXPECT_LE(landmarks.LowerBound(start_node->Index(), mid_node->Index()) * model.MetricScale(),
+              ReferenceDistance(model, start_node->Index(), mid_node->Index()) + 1e-2);
+
+    route_planner.Search(RoutePlanner::SearchMode::ALT);
+    EXPECT_NEAR(route_planner.GetDistance(), ReferenceDistance(model, start_node->Index(), end_node->Index()), 1e-2);
+    EXPECT_EQ(route_planner.GetPath().back().Index(), end_node->Index());
+}
+
+
+// Test that the one-to-all distance field matches the reference and respects the cutoff.
+TEST_F(RoutePlannerTest, TestOneToAllSearch) {
+    const auto &graph = model.RoadGraph();
+    route_planner.AStarSearch();
+    route_planner.OneToAllSearch();
+    // A one-to-all search finds no route, so nothing is left of the previous one.
+    EXPECT_TRUE(route_planner.GetPath().empty());
+    EXPECT_EQ(route_planner.GetDistance(), 0.0f);
+    const auto &field = route_planner.GetDistanceField();
+    ASSERT_EQ(field.size(), model.SNodes().size());
+    EXPECT_FLOAT_EQ(field[start_node->Index()], 0.0f);
+    for (auto node : {end_node, mid_node})
+        EXPECT_NEAR(field[node->Index()], ReferenceDistance(model, start_node->Index(), node->Index()), 1e-2);
+
+    const float cutoff = field[mid_node->Index()];
+    route_planner.OneToAllSearch(cutoff);
+    const auto &cut_field = route_planner.GetDistanceField();
+    for (int i = 0; i < model.SNodes().size(); i++) {
+        if (cut_field[i] != std::numeric_limits<float>::infinity())
+            EXPECT_LE(cut_field[i], cutoff);
+        else if (graph.offsets[i + 1] > graph.offsets[i] && field[i] < cutoff * 0.99f)
+            ADD_FAILURE() << "node " << i << " within the cutoff was not reached";
+    }
+
+    // Every reached node lies inside the counter-clockwise isochrone polygon.
+    const auto &polygon = route_planner.GetIsochrone();
+    ASSERT_GE(polygon.size(), 3);
+    for (int i = 0; i < model.SNodes().size(); i++) {
+        if (cut_field[i] == std::numeric_limits<float>::infinity())
+            continue;
+        const auto &p = model.SNodes()[i];
+        for (int j = 0; j < polygon.size(); j++) {
+            const auto &a = polygon[j], &b = polygon[(j + 1) % polygon.size()];
+            EXPECT_GE((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x), -1e-9);
+        }
+    }
+}
+
+
+// Test many-to-many distances with and without the contraction hierarchy.
+TEST_F(RoutePlannerTest, TestDistanceMatrix) {
+    std::vector<int> sources, targets;
+    for (float x : {0.1f, 0.4f, 0.8f})
+        sources.push_back(model.FindClosestNode(x, 1.0f - x).Index());
+    for (float x : {0.05f, 0.3f, 0.5f, 0.95f})
+        targets.push_back(model.FindClosestNode(x, x).Index());
+    targets.push_back(sources[1]);
+
+    DistanceMatrix dijkstra{model, sources, targets, 2, true};
+    ASSERT_EQ(dijkstra.Rows(), sources.size());
+    ASSERT_EQ(dijkstra.Columns(), targets.size());
+    for (int row = 0; row < sources.size(); row++)
+        for (int column = 0; column < targets.size(); column++) {
+            EXPECT_NEAR(dijkstra.Distance(row, column), ReferenceDistance(model, sources[row], targets[column]), 1e-2);
+            const auto &path = dijkstra.Path(row, column);
+            ASSERT_FALSE(path.empty());
+            EXPECT_EQ(path.front(), sources[row]);
+            EXPECT_EQ(path.back(), targets[column]);
+        }
+    EXPECT_FLOAT_EQ(dijkstra.Distance(1, targets.size() - 1), 0.0f);
+
+    model.BuildContractionHierarchy();
+    DistanceMatrix buckets{model, sources, targets, 2};
+    for (int row = 0; row < sources.size(); row++)
+        for (int column = 0; column < targets.size(); column++) {
+            EXPECT_NEAR(buckets.Distance(row, column), dijkstra.Distance(row, column), 1e-2);
+            EXPECT_TRUE(buckets.Path(row, column).empty());
+        }
+}
+
+
+// Test that the speed profiles route by travel time on the roads open to them, and that
+// speeds can be changed without reloading the map.
+TEST_F(RoutePlannerTest, TestSpeedProfiles) {
+    using Profile = RouteModel::Profile;
+    const auto &distance_graph = model.RoadGraph(Profile::Distance);
+    const auto &foot_graph = model.RoadGraph(Profile::Foot);
+    EXPECT_GT(foot_graph.targets.size(), distance_graph.targets.size());
+    EXPECT_FLOAT_EQ(distance_graph.cost_scale, model.MetricScale());
+
+    for (auto profile : {Profile::Car, Profile::Bike, Profile::Foot}) {
+        RoutePlanner planner{model, 10, 10, 90, 90, profile};
+        planner.AStarSearch();
+        ASSERT_FALSE(planner.GetPath().empty());
+        const int start = planner.GetPath().front().Index();
+        const int end = planner.GetPath().back().Index();
+        EXPECT_NEAR(planner.GetCost(), ReferenceDistance(model, start, end, profile), 1e-2);
+        if (profile == Profile::Car) {
+            EXPECT_GE(planner.GetDistance(), ReferenceDistance(model, start, end) - 1e-2);
+        }
+        planner.BidirectionalAStarSearch();
+        EXPECT_NEAR(planner.GetCost(), ReferenceDistance(model, start, end, profile), 1e-2);
+    }
+
+    // Walking the shortest route at 5 km/h.
+    RoutePlanner walk{model, 10, 10, 90, 90, Profile::Foot};
+    walk.AStarSearch();
+    EXPECT_NEAR(walk.GetCost(), walk.GetDistance() / (5.0f / 3.6f), 1.0f);
+
+    model.BuildContractionHierarchy(Profile::Car);
+    RoutePlanner car{model, 10, 10, 90, 90, Profile::Car};
+    car.AStarSearch();
+    const float expected = car.GetCost();
+    car.ContractionHierarchySearch();
+    EXPECT_NEAR(car.GetCost(), expected, 1e-2);
+    EXPECT_EQ(model.Hierarchy(Profile::Distance), nullptr);
+
+    const auto car_edges = model.RoadGraph(Profile::Car).targets.size();
+    auto speeds = RouteModel::DefaultSpeeds(Profile::Car);
+    speeds[Model::Road::Residential] = 0.f;
+    model.SetSpeeds(Profile::Car, speeds);
+    EXPECT_LT(model.RoadGraph(Profile::Car).targets.size(), car_edges);
+    EXPECT_EQ(model.Hierarchy(Profile::Car), nullptr);
+
+    // With every road closed there is nothing to snap to.
+    for (auto &[type, speed] : speeds)
+        speed = 0.f;
+    model.SetSpeeds(Profile::Car, speeds);
+    EXPECT_TRUE(model.FindClosestNodes(0.5f, 0.5f, 3, Profile::Car).empty());
+    EXPECT_THROW(model.FindClosestNode(0.5f, 0.5f, Profile::Car), std::logic_error);
+    EXPECT_THROW((RoutePlanner{model, 10, 10, 90, 90, Profile::Car}), std::logic_error);
+}
+
+
+// Test that the query stats count the work of each search and are written as one JSON line.
+TEST_F(RoutePlannerTest, TestQueryStats) {
+    route_planner.AStarSearch();
+    const auto astar = route_planner.GetStats();
+    EXPECT_STREQ(astar.search, "astar");
+    EXPECT_GT(astar.nodes_expanded, 0);
+    EXPECT_GE(astar.nodes_pushed, astar.nodes_expanded);
+    EXPECT_GT(astar.max_open_list_size, 0);
+    EXPECT_LE(astar.max_open_list_size, astar.nodes_pushed);
+    EXPECT_GE(astar.heuristic_evaluations, astar.nodes_pushed);
+    EXPECT_GT(astar.snap_time, 0.0);
+    EXPECT_GT(astar.search_time, 0.0);
+    EXPECT_GT(astar.path_time, 0.0);
+
+    // Landmarks tighten the heuristic, so ALT expands at most as many nodes as A*.
+    model.BuildLandmarks(4);
+    route_planner.Search(RoutePlanner::SearchMode::ALT);
+    EXPECT_STREQ(route_planner.GetStats().search, "alt");
+    EXPECT_LE(route_planner.GetStats().nodes_expanded, astar.nodes_expanded);
+    EXPECT_DOUBLE_EQ(route_planner.GetStats().snap_time, astar.snap_time);
+
+    route_planner.BidirectionalAStarSearch();
+    EXPECT_STREQ(route_planner.GetStats().search, "bidirectional");
+    EXPECT_GT(route_planner.GetStats().nodes_expanded, 0);
+
+    std::ostringstream os;
+    route_planner.WriteStats(os);
+    const auto line = os.str();
+    EXPECT_EQ(line.front(), '{');
+    EXPECT_EQ(line.substr(line.size() - 2), "}\n");
+    EXPECT_EQ(std::count(line.begin(), line.end(), '\n'), 1);
+    EXPECT_NE(line.find("\"search\":\"bidirectional\""), std::string::npos);
+    EXPECT_NE(line.find("\"nodes_expanded\":" + std::to_string(route_planner.GetStats().nodes_expanded)), std::string::npos);
+}
+
+
+// Test that planners sharing one model can search concurrently and reuse workspaces.
+TEST_F(RoutePlannerTest, TestConcurrentSearches) {
+    route_planner.AStarSearch();
+    const float expected = route_planner.GetDistance();
+
+    std::vector<float> distances(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < distances.size(); t++)
+        threads.emplace_back([&, t] {
+            SearchWorkspace workspace(model.SNodes().size());
+            for (int i = 0; i < 3; i++) {
+                RoutePlanner planner{model, workspace, 10, 10, 90, 90};
+                planner.AStarSearch();
+                distances[t] = planner.GetDistance();
+            }
+        });
+    for (auto &thread : threads)
+        thread.join();
+    for (float distance : distances)
+        EXPECT_FLOAT_EQ(distance, expected);
+}
+
+
+// Test FindClosestNode and FindClosestNodes against a linear scan of all routable nodes.
+TEST_F(RoutePlannerTest, TestFindClosestNodes) {
+    // The car graph leaves out footways, so part of the indexed nodes must be skipped.
+    for (auto profile : {RouteModel::Profile::Distance, RouteModel::Profile::Car}) {
+        const auto &graph = model.RoadGraph(profile);
+        RouteModel::Node query;
+        for (float x : {0.05f, 0.3f, 0.5f, 0.77f, 1.2f}) {
+            query.x = x;
+            query.y = 1.0f - x;
+            std::vector<std::pair<float, int>> expected;
+            for (int i = 0; i < model.SNodes().size(); i++)
+                if (graph.offsets[i + 1] > graph.offsets[i])
+                    expected.emplace_back(query.distance(model.SNodes()[i]), i);
+            std::sort(expected.begin(), expected.end());
+
+            EXPECT_FLOAT_EQ(query.distance(model.FindClosestNode(query.x, query.y, profile)), expected[0].first);
+            auto closest = model.FindClosestNodes(query.x, query.y, 5, profile);
+            ASSERT_EQ(closest.size(), 5);
+            for (int i = 0; i < closest.size(); i++)
+                EXPECT_FLOAT_EQ(query.distance(*closest[i]), expected[i].first);
+        }
+    }
+}
+
+
+// Test that the streaming loader builds the same model as the DOM loader, even when
+// the input arrives in chunks that split markup at arbitrary positions.
+TEST_F(RoutePlannerTest, TestStreamingLoader) {
+    std::ifstream is{osm_data_file, std::ios::binary};
+    RouteModel streamed{is};
+
+    // A fresh mapping, since the fixture's one was consumed by in-place parsing.
+    MappedFile xml{osm_data_file};
+
+    struct Counter : OSMStreamParser::Handler {
+        int nodes = 0, ways = 0;
+        void OnNode(const OSMStreamParser::Node &) override { nodes++; }
+        void OnWay(const OSMStreamParser::Way &) override { ways++; }
+    } counter;
+    OSMStreamParser parser{counter};
+    for (std::size_t pos = 0; pos < xml.Size(); pos += 7)
+        parser.Feed(xml.Data() + pos, std::min<std::size_t>(7, xml.Size() - pos));
+    parser.Finish();
+
+    EXPECT_EQ(counter.nodes, model.Nodes().size());
+    EXPECT_LE(counter.ways, model.Ways().size());
+    ASSERT_EQ(streamed.Nodes().size(), model.Nodes().size());
+    ASSERT_EQ(streamed.Ways().size(), model.Ways().size());
+    EXPECT_EQ(streamed.Roads().size(), model.Roads().size());
+    EXPECT_EQ(streamed.Buildings().size(), model.Buildings().size());
+    EXPECT_EQ(streamed.Landuses().size(), model.Landuses().size());
+    EXPECT_EQ(streamed.RoadGraph().targets, model.RoadGraph().targets);
+    for (int i = 0; i < model.Nodes().size(); i++) {
+        EXPECT_DOUBLE_EQ(streamed.Nodes()[i].x, model.Nodes()[i].x);
+        EXPECT_DOUBLE_EQ(streamed.Nodes()[i].y, model.Nodes()[i].y);
+    }
+    for (int i = 0; i < model.Ways().size(); i++)
+        EXPECT_EQ(streamed.Ways()[i].nodes, model.Ways()[i].nodes);
+}
+
+
+// Test that loading with several threads builds the same model as a sequential load.
+TEST_F(RoutePlannerTest, TestParallelLoader) {
+    MappedFile xml{osm_data_file};
+    RouteModel parallel{xml, 4};
+
+    ASSERT_EQ(parallel.Nodes().size(), model.Nodes().size());
+    ASSERT_EQ(parallel.Ways().size(), model.Ways().size());
+    for (int i = 0; i < model.Nodes().size(); i++) {
+        EXPECT_DOUBLE_EQ(parallel.Nodes()[i].x, model.Nodes()[i].x);
+        EXPECT_DOUBLE_EQ(parallel.Nodes()[i].y, model.Nodes()[i].y);
+    }
+    for (int i = 0; i < model.Ways().size(); i++)
+        EXPECT_EQ(parallel.Ways()[i].nodes, model.Ways()[i].nodes);
+    ASSERT_EQ(parallel.Roads().size(), model.Roads().size());
+    for (int i = 0; i < model.Roads().size(); i++)
+        EXPECT_EQ(parallel.Roads()[i].way, model.Roads()[i].way);
+    EXPECT_EQ(parallel.Buildings().size(), model.Buildings().size());
+    EXPECT_EQ(parallel.Landuses().size(), model.Landuses().size());
+    EXPECT_EQ(parallel.RoadGraph().targets, model.RoadGraph().targets);
+}
+
+
+// Test that a model saved to a map cache loads back identically and routes the same.
+TEST_F(RoutePlannerTest, TestMapCacheRoundTrip) {
+    std::string cache_file = "utest_map_cache.rmap";
+    model.BuildContractionHierarchy();
+    model.BuildLandmarks(4);
+    {
+        std::ofstream os{cache_file, std::ios::binary};
+        MapCacheWriter writer{os};
+        model.Save(writer);
+    }
+    MappedFile mapped{cache_file};
+    ASSERT_TRUE(IsMapCache(mapped));
+    MapCacheReader reader{mapped};
+    RouteModel cached{reader};
+    std::remove(cache_file.c_str());
+
+    EXPECT_DOUBLE_EQ(cached.MetricScale(), model.MetricScale());
+    ASSERT_EQ(cached.Nodes().size(), model.Nodes().size());
+    ASSERT_EQ(cached.Ways().size(), model.Ways().size());
+    for (int i = 0; i < model.Ways().size(); i++)
+        EXPECT_EQ(cached.Ways()[i].nodes, model.Ways()[i].nodes);
+    EXPECT_EQ(cached.Roads().size(), model.Roads().size());
+    EXPECT_EQ(cached.Landuses().size(), model.Landuses().size());
+    EXPECT_EQ(cached.NodeCoordinates().x, model.NodeCoordinates().x);
+    EXPECT_EQ(cached.NodeCoordinates().y, model.NodeCoordinates().y);
+    EXPECT_EQ(cached.RoadGraph().offsets, model.RoadGraph().offsets);
+    EXPECT_EQ(cached.RoadGraph().weights, model.RoadGraph().weights);
+    ASSERT_NE(cached.Hierarchy(), nullptr);
+    EXPECT_EQ(cached.Hierarchy()->EdgeCount(), model.Hierarchy()->EdgeCount());
+    ASSERT_NE(cached.GetLandmarks(), nullptr);
+    EXPECT_EQ(cached.GetLandmarks()->Nodes(), model.GetLandmarks()->Nodes());
+
+    RoutePlanner cached_planner{cached, 10, 10, 90, 90};
+    cached_planner.AStarSearch();
+    route_planner.AStarSearch();
+    EXPECT_EQ(cached_planner.GetPath().size(), route_planner.GetPath().size());
+    EXPECT_FLOAT_EQ(cached_planner.GetDistance(), route_planner.GetDistance());
+    cached_planner.Search(RoutePlanner::SearchMode::ContractionHierarchy);
+    EXPECT_NEAR(cached_planner.GetDistance(), route_planner.GetDistance(), 1e-2);
+}
+
+
+// Test that a cache of the right size but with an out of range node id is rejected on load.
+TEST_F(RoutePlannerTest, TestMapCacheRejectsBadIndices) {
+    std::ostringstream os;
+    {
+        MapCacheWriter writer{os};
+        model.Save(writer);
+    }
+    std::string data = os.str();
+
+    // Find the node list of the first way in the flat way array and point it past the nodes.
+    const auto &nodes = model.Ways().front().nodes;
+    ASSERT_GE(nodes.size(), 2);
+    const std::string list(reinterpret_cast<const char *>(nodes.data()), nodes.size() * sizeof(int));
+    const auto pos = data.find(list);
+    ASSERT_NE(pos, std::string::npos);
+    const int bad_node = (int)model.Nodes().size() + 7;
+    std::memcpy(&data[pos], &bad_node, sizeof(int));
+
+    std::string cache_file = "utest_bad_map_cache.rmap";
+    std::ofstream{cache_file, std::ios::binary} << data;
+    MappedFile mapped{cache_file};
+    MapCacheReader reader{mapped};
+    EXPECT_THROW(RouteModel{reader}, std::logic_error);
+    std::remove(cache_file.c_str());
+}
+
+
+// Test the IndexedHeap backing the open list.
+TEST(IndexedHeapTest, TestPopOrderAndDecreaseKey) {
+    IndexedHeap heap(5);
+    heap.Push(0, 4.0f);
+    heap.Push(1, 2.0f);
+    heap.Push(2, 3.0f);
+    heap.Push(3, 5.0f);
+    heap.Push(3, 1.0f);
+    heap.DecreaseKey(2, 6.0f);
+    EXPECT_EQ(heap.Size(), 4);
+    EXPECT_TRUE(heap.Contains(3));
+    EXPECT_FALSE(heap.Contains(4));
+
+    std::vector<int> order;
+    while (!heap.Empty())
+        order.push_back(heap.Pop());
+    EXPECT_EQ(order, (std::vector<int>{3, 1, 2, 0}));
+    EXPECT_FALSE(heap.Contains(3));
+}
+
+
+
+// Test that every generated layout loads, has about the requested size and is routable.
+TEST(OsmGeneratorTest, TestLayoutsLoad) {
+    for (auto layout : {OsmGenerator::Layout::Grid, OsmGenerator::Layout::RandomPlanar, OsmGenerator::Layout::City}) {
+        OsmGenerator::Options options;
+        options.layout = layout;
+        options.nodes = 20000;
+        std::stringstream osm;
+        OsmGenerator{options}.Write(osm);
+        RouteModel model{osm};
+        EXPECT_GT(model.SNodes().size(), 15000);
+        EXPECT_LT(model.SNodes().size(), 25000);
+        EXPECT_FALSE(model.Roads().empty());
+        EXPECT_EQ(model.Buildings().empty(), layout != OsmGenerator::Layout::City);
+
+        RoutePlanner planner{model, 10, 10, 90, 90};
+        planner.AStarSearch();
+        EXPECT_FALSE(planner.GetPath().empty());
+        EXPECT_GT(planner.GetDistance(), 0.0f);
+
+        std::stringstream again;
+        OsmGenerator{options}.Write(again);
+        EXPECT_EQ(again.str(), osm.str());
+    }
+}
+
+
+// Test the IdMap used to resolve OSM ids while loading.
+TEST(IdMapTest, TestInsertAndFind) {
+    IdMap ids;
+    for (int i = 0; i < 1000; i++)
+        ids.Insert(7000000000ll + 3 * i, i);
+    ids.Insert(-42, 5);
+    ids.Insert(7000000000ll, 9);
+
+    EXPECT_EQ(ids.Size(), 1001);
+    EXPECT_EQ(ids.Find(7000000000ll), 9);
+    EXPECT_EQ(ids.Find(7000000000ll + 3 * 999), 999);
+    EXPECT_EQ(ids.Find(-42), 5);
+    EXPECT_EQ(ids.Find(7000000001ll), -1);
+    ids.Clear();
+    EXPECT_EQ(ids.Find(-42), -1);
+}
+
+// Test that the runtime-selected distance kernel matches the scalar one for every tail length.
+TEST(DistanceKernelsTest, TestMatchesScalar) {
+    std::vector<float> xs, ys;
+    for (int i = 0; i < 37; i++) {
+        xs.push_back(0.013f * i * i);
+        ys.push_back(1.0f - 0.029f * i);
+    }
+    for (std::size_t count = 0; count <= xs.size(); count++) {
+        std::vector<float> expected(count), actual(count);
+        SquaredDistancesScalar(xs.data(), ys.data(), count, 0.31f, 0.47f, expected.data());
+        SquaredDistances(xs.data(), ys.data(), count, 0.31f, 0.47f, actual.data());
+        EXPECT_EQ(actual, expected) << SquaredDistancesKernel() << " kernel, " << count << " points";
+    }
+}
+
+// Test that grid queries report every intersecting box exactly once, in ascending order.
+TEST(FeatureGridTest, TestQueryMatchesBruteForce) {
+    std::vector<FeatureGrid::Box> boxes;
+    for (int i = 0; i < 500; i++) {
+        const float x = std::fmod(0.618f * i, 1.f), y = std::fmod(0.377f * i, 1.f);
+        const float size = i % 10 == 0 ? 0.3f : 0.01f * (i % 4);
+        boxes.push_back({x, y, x + size, y + size / 2});
+    }
+    FeatureGrid grid{boxes, 4};
+    std::vector<int> features;
+    for (int q = 0; q < 50; q++) {
+        const float x = std::fmod(0.71f * q, 1.2f) - 0.1f, y = std::fmod(0.43f * q, 1.2f) - 0.1f;
+        const FeatureGrid::Box query{x, y, x + 0.02f * (q % 7), y + 0.05f * (q % 3)};
+        std::vector<int> expected;
+        for (int i = 0; i < (int)boxes.size(); i++)
+            if (boxes[i].Intersects(query))
+                expected.push_back(i);
+        grid.Query(query, features);
+        EXPECT_EQ(features, expected) << "query " << q;
+    }
+    grid.Query({-1.f, -1.f, 2.f, 2.f}, features);
+    EXPECT_EQ(features.size(), boxes.size());
+}
+
+// Test that simplification keeps both ends and corners, and drops nodes within tolerance.
+TEST(SimplifyTest, TestDouglasPeucker) {
+    std::vector<Model::Node> nodes;
+    Model::Way way;
+    for (int i = 0; i <= 20; i++) {
+        nodes.push_back({0.01 * i, i % 2 ? 0.0001 : -0.0001});
+        way.nodes.push_back(i);
+    }
+    nodes.push_back({0.2, 0.1});
+    way.nodes.push_back(21);
+
+    EXPECT_EQ(SimplifyWay(nodes, way, 0.001).nodes, (std::vector<int>{0, 20, 21}));
+    EXPECT_EQ(SimplifyWay(nodes, way, 0.00001).nodes, way.nodes);
+
+    Model::Way ring;
+    ring.nodes = {0, 10, 21, 0};
+    EXPECT_EQ(SimplifyWay(nodes, ring, 0.001).nodes, ring.nodes);
 }
@@ -0,0 +1,50 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "../src/osm_generator.h"
+
+// Writes a synthetic OSM map for load and search benchmarks on maps of any size.
+int main(int argc, const char **argv)
+{
+    OsmGenerator::Options options;
+    std::string output_file = "";
+    for( int i = 1; i < argc; ++i )
+        if( std::string_view{argv[i]} == "-l" && ++i < argc ) {
+            auto layout = OsmGenerator::ParseLayout(argv[i]);
+            if( !layout ) {
+                std::cerr << "Unknown layout: " << argv[i] << std::endl;
+                return 1;
+            }
+            options.layout = *layout;
+        }
+        else if( std::string_view{argv[i]} == "-n" && ++i < argc )
+            options.nodes = std::strtoull(argv[i], nullptr, 10);
+        else if( std::string_view{argv[i]} == "-s" && ++i < argc )
+            options.seed = std::strtoull(argv[i], nullptr, 10);
+        else if( std::string_view{argv[i]} == "-o" && ++i < argc )
+            output_file = argv[i];
+        else {
+            std::cerr << "Usage: [executable] [-l grid|random|city] [-n nodes] [-s seed] [-o filename.osm]" << std::endl;
+            std::cerr << "  -l  road network layout (defaults to grid)" << std::endl;
+            std::cerr << "  -n  approximate number of nodes (defaults to 10000)" << std::endl;
+            std::cerr << "  -s  random seed; the same options always give the same map" << std::endl;
+            std::cerr << "  -o  output file (defaults to the standard output)" << std::endl;
+            return 1;
+        }
+
+    OsmGenerator generator{options};
+    std::cerr << "Generating a " << generator.GridSize() << " x " << generator.GridSize() << " road network..." << std::endl;
+    if( output_file.empty() ) {
+        std::ios::sync_with_stdio(false);
+        generator.Write(std::cout);
+        return std::cout ? 0 : 1;
+    }
+    std::ofstream os{output_file, std::ios::binary};
+    generator.Write(os);
+    if( !os ) {
+        std::cerr << "Failed to write " << output_file << std::endl;
+        return 1;
+    }
+}